@@ -0,0 +1,473 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <benchmark/benchmark.h>
+#include <ros/ros.h>
+#include <velodyne_puck_decoder/velodyne_puck_decoder.h>
+
+// Allocations on the benchmark thread while they are counted. The
+// other threads of roscpp allocate as well, and are not counted.
+namespace {
+thread_local bool count_allocations = false;
+thread_local size_t allocation_count = 0;
+}
+
+void* operator new(size_t size) {
+  if (count_allocations) ++allocation_count;
+  void* ptr = std::malloc(size > 0 ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+namespace velodyne_puck_decoder {
+
+// Packets of the benchmarks, with the period at which they are sent.
+struct PacketSet {
+  std::vector<velodyne_puck_msgs::VelodynePuckPacketPtr> packets;
+  ros::Duration packet_duration;
+};
+
+enum PacketSource {SYNTHETIC, CORPUS};
+
+// Two revolutions of VLP-16 packets with a return for every shot, the
+// worst case for the decoder. The sensor turns 0.4 degree per firing,
+// close to 20Hz, so that the set covers exactly 1800 firings.
+const PacketSet& syntheticPackets() {
+  static PacketSet set;
+  if (!set.packets.empty()) return set;
+
+  const size_t packets = 75;
+  const size_t firings_per_block = 2;
+  size_t fir_idx = 0;
+  for (size_t pkt_idx = 0; pkt_idx < packets; ++pkt_idx) {
+    velodyne_puck_msgs::VelodynePuckPacketPtr msg(
+        new velodyne_puck_msgs::VelodynePuckPacket());
+    uint8_t* block = &msg->data[0];
+    for (size_t blk_idx = 0; blk_idx < BLOCKS_PER_PACKET; ++blk_idx) {
+      uint16_t header = UPPER_BANK;
+      uint16_t azimuth = static_cast<uint16_t>(
+          (fir_idx*40) % RAW_AZIMUTH_COUNT);
+      std::memcpy(block, &header, 2);
+      std::memcpy(block+2, &azimuth, 2);
+      for (size_t shot_idx = 0; shot_idx < SCANS_PER_BLOCK; ++shot_idx) {
+        uint16_t distance = static_cast<uint16_t>(
+            2500 + (shot_idx*37 + fir_idx*11) % 5000);
+        std::memcpy(block+4+shot_idx*RAW_SCAN_SIZE, &distance, 2);
+        block[4+shot_idx*RAW_SCAN_SIZE+2] =
+          static_cast<uint8_t>(shot_idx*7 + fir_idx);
+      }
+      block += SIZE_BLOCK;
+      fir_idx += firings_per_block;
+    }
+    msg->data[PACKET_SIZE-2] = 0x37;
+    msg->data[PACKET_SIZE-1] = VLP16;
+    set.packets.push_back(msg);
+  }
+  set.packet_duration = ros::Duration(
+      MAX_FIRINGS_PER_PACKET*FIRING_TOFFSET*1e-6);
+  return set;
+}
+
+// Packets as sent to the data port, concatenated in a file. By default
+// the synthetic corpus of the regression test, which
+// VELODYNE_PUCK_PACKETS replaces, e.g. with a capture of a sensor.
+const PacketSet& corpusPackets() {
+  static PacketSet set;
+  if (!set.packets.empty()) return set;
+
+  const char* path = std::getenv("VELODYNE_PUCK_PACKETS");
+  std::ifstream recording(path ? path : VELODYNE_PUCK_CORPUS,
+      std::ios::binary);
+  while (recording) {
+    velodyne_puck_msgs::VelodynePuckPacketPtr msg(
+        new velodyne_puck_msgs::VelodynePuckPacket());
+    recording.read(reinterpret_cast<char*>(&msg->data[0]), PACKET_SIZE);
+    if (recording.gcount() != PACKET_SIZE) break;
+    set.packets.push_back(msg);
+  }
+  set.packet_duration = ros::Duration(
+      MAX_FIRINGS_PER_PACKET*FIRING_TOFFSET*1e-6);
+  return set;
+}
+
+const PacketSet& packetSet(const int& source) {
+  return source == SYNTHETIC ? syntheticPackets() : corpusPackets();
+}
+
+const char* packetSetLabel(const int& source) {
+  if (source == SYNTHETIC) return "synthetic";
+  return std::getenv("VELODYNE_PUCK_PACKETS") ? "recorded" : "corpus";
+}
+
+template <typename M>
+void dropMessage(const boost::shared_ptr<const M>& msg) {
+  return;
+}
+
+// Opens up the stages of the decoder to the benchmarks.
+class StageDecoder : public VelodynePuckDecoder {
+public:
+  StageDecoder(ros::NodeHandle& nh, ros::NodeHandle& pnh):
+    VelodynePuckDecoder(nh, pnh) {}
+
+  using VelodynePuckDecoder::FiringBuffer;
+  using VelodynePuckDecoder::RawPacket;
+  using VelodynePuckDecoder::packetCallback;
+  using VelodynePuckDecoder::configureSensor;
+  using VelodynePuckDecoder::sensorInfo;
+  using VelodynePuckDecoder::checkPacketValidity;
+  using VelodynePuckDecoder::decodePacket;
+  using VelodynePuckDecoder::convertFirings;
+  using VelodynePuckDecoder::processPacket;
+  using VelodynePuckDecoder::assemblePacket;
+  using VelodynePuckDecoder::startSweep;
+  using VelodynePuckDecoder::fillSweep;
+  using VelodynePuckDecoder::firingsPerPacket;
+  using VelodynePuckDecoder::publishPointCloud;
+  using VelodynePuckDecoder::isPointInRange;
+};
+
+/*
+ * Drives the stages of a decoder one packet at a time. The decoder
+ * is set up for the sensor of the packets, with subscribers to the
+ * requested outputs, and all the packets are decoded up front.
+ */
+class DecoderBenchmark {
+public:
+  enum Output {NONE = 0, SWEEP = 1, POINT_CLOUD = 2};
+
+  DecoderBenchmark(const PacketSet& set, const int& outputs):
+    nh("velodyne_puck_benchmarks"),
+    pnh("~"),
+    decoder(nh, pnh),
+    packets(set.packets),
+    packet_duration(set.packet_duration),
+    valid(false) {
+    if (packets.empty() || !decoder.initialize()) return;
+
+    if (outputs & SWEEP)
+      sweep_sub = nh.subscribe("velodyne_sweep", 1,
+          &dropMessage<velodyne_puck_msgs::VelodynePuckSweep>);
+    if (outputs & POINT_CLOUD)
+      point_cloud_sub = nh.subscribe("velodyne_point_cloud", 1,
+          &dropMessage<sensor_msgs::PointCloud2>);
+    ros::WallTime timeout = ros::WallTime::now() + ros::WallDuration(1.0);
+    while (ros::WallTime::now() < timeout &&
+        (((outputs & SWEEP) && !sweep_sub.getNumPublishers()) ||
+         ((outputs & POINT_CLOUD) && !point_cloud_sub.getNumPublishers())))
+      ros::WallDuration(0.001).sleep();
+
+    // The packets of other sensors or with broken
+    // headers are left out.
+    if (!decoder.configureSensor(*packets[0])) return;
+    std::vector<velodyne_puck_msgs::VelodynePuckPacketPtr> valid_packets;
+    for (size_t pkt_idx = 0; pkt_idx < packets.size(); ++pkt_idx) {
+      buffers.push_back(StageDecoder::FiringBuffer());
+      if (!decoder.processPacket(*packets[pkt_idx], buffers.back())) {
+        buffers.pop_back();
+        continue;
+      }
+      decoder.convertFirings(buffers.back());
+      valid_packets.push_back(packets[pkt_idx]);
+      points.push_back(0);
+      for (size_t shot_idx = 0; shot_idx < SCANS_PER_PACKET; ++shot_idx)
+        if (decoder.isPointInRange(buffers.back().distance[shot_idx]))
+          ++points.back();
+    }
+    packets.swap(valid_packets);
+    start = ros::Time::now();
+    valid = !packets.empty();
+  }
+
+  bool isValid() const {
+    return valid;
+  }
+  size_t packetCount() const {
+    return packets.size();
+  }
+  size_t pointCount(const size_t& pkt_idx) const {
+    return points[pkt_idx];
+  }
+  // Packets of about one revolution from the first one.
+  size_t revolutionPackets() const {
+    int span = 0;
+    size_t pkt_idx = 1;
+    for (; pkt_idx < packets.size() && span < RAW_AZIMUTH_COUNT; ++pkt_idx) {
+      int step = static_cast<int>(buffers[pkt_idx].firing_azimuth[0]) -
+        buffers[pkt_idx-1].firing_azimuth[0];
+      span += step < 0 ? step + RAW_AZIMUTH_COUNT : step;
+    }
+    return pkt_idx;
+  }
+
+  bool checkPacketValidity(const size_t& pkt_idx) {
+    return decoder.checkPacketValidity(
+        reinterpret_cast<const StageDecoder::RawPacket*>(
+          &packets[pkt_idx]->data[0]));
+  }
+
+  // Decode only, without the validity check and the conversion to xyz.
+  void decodePacket(const size_t& pkt_idx) {
+    const StageDecoder::RawPacket* raw_packet =
+      reinterpret_cast<const StageDecoder::RawPacket*>(
+          &packets[pkt_idx]->data[0]);
+    switch (decoder.sensorInfo().model) {
+      case VLP16:
+        decoder.decodePacket<VLP16Traits>(raw_packet, firings);
+        break;
+      case PUCK_HI_RES:
+        decoder.decodePacket<PuckHiResTraits>(raw_packet, firings);
+        break;
+      case VLP32C:
+        decoder.decodePacket<VLP32CTraits>(raw_packet, firings);
+        break;
+      default:
+        break;
+    }
+    return;
+  }
+
+  void convertFirings(const size_t& pkt_idx) {
+    decoder.convertFirings(buffers[pkt_idx]);
+    return;
+  }
+
+  // The packets are stamped as the sequence goes on, so that
+  // the sweeps are cut as they come from the sensor.
+  void assemblePacket(const size_t& seq) {
+    size_t pkt_idx = seq % packets.size();
+    packets[pkt_idx]->stamp = start + packet_duration*seq;
+    decoder.assemblePacket(buffers[pkt_idx], packets[pkt_idx]);
+    return;
+  }
+
+  void packetCallback(const size_t& seq) {
+    size_t pkt_idx = seq % packets.size();
+    packets[pkt_idx]->stamp = start + packet_duration*seq;
+    decoder.packetCallback(packets[pkt_idx]);
+    return;
+  }
+
+  // Start a new sweep with the given packets.
+  void fillSweep(const size_t& pkt_count) {
+    decoder.startSweep(start.toNSec());
+    for (size_t pkt_idx = 0; pkt_idx < pkt_count; ++pkt_idx)
+      decoder.fillSweep(buffers[pkt_idx], 0, decoder.firingsPerPacket());
+    return;
+  }
+
+  void publishPointCloud() {
+    decoder.publishPointCloud();
+    return;
+  }
+
+private:
+  ros::NodeHandle nh;
+  ros::NodeHandle pnh;
+  StageDecoder decoder;
+  ros::Subscriber sweep_sub;
+  ros::Subscriber point_cloud_sub;
+
+  std::vector<velodyne_puck_msgs::VelodynePuckPacketPtr> packets;
+  ros::Duration packet_duration;
+  std::vector<StageDecoder::FiringBuffer> buffers;
+  std::vector<size_t> points;
+  StageDecoder::FiringBuffer firings;
+  ros::Time start;
+  bool valid;
+};
+
+} // end namespace velodyne_puck_decoder
+
+using namespace velodyne_puck_decoder;
+
+namespace {
+
+// The decoder advertises its outputs, which needs a ROS master.
+bool setUp(benchmark::State& state, const int& outputs,
+    boost::scoped_ptr<DecoderBenchmark>& bench) {
+  state.SetLabel(packetSetLabel(state.range(0)));
+  if (!ros::master::check()) {
+    state.SkipWithError("No ROS master to advertise the outputs");
+    return false;
+  }
+  bench.reset(new DecoderBenchmark(packetSet(state.range(0)), outputs));
+  if (!bench->isValid()) {
+    state.SkipWithError("No packets of a supported sensor");
+    return false;
+  }
+  return true;
+}
+
+// The time of each iteration is the time per packet.
+void reportPackets(benchmark::State& state, const size_t& points) {
+  state.counters["packets/s"] =
+    benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["points/s"] =
+    benchmark::Counter(points, benchmark::Counter::kIsRate);
+  state.counters["allocs/packet"] = benchmark::Counter(
+      allocation_count, benchmark::Counter::kAvgIterations);
+  return;
+}
+
+void BM_CheckPacketValidity(benchmark::State& state) {
+  boost::scoped_ptr<DecoderBenchmark> bench;
+  if (!setUp(state, DecoderBenchmark::NONE, bench)) return;
+  size_t seq = 0;
+  size_t points = 0;
+  allocation_count = 0;
+  count_allocations = true;
+  for (auto _ : state) {
+    size_t pkt_idx = seq++ % bench->packetCount();
+    benchmark::DoNotOptimize(bench->checkPacketValidity(pkt_idx));
+    points += bench->pointCount(pkt_idx);
+  }
+  count_allocations = false;
+  reportPackets(state, points);
+}
+BENCHMARK(BM_CheckPacketValidity)->Arg(SYNTHETIC)->Arg(CORPUS);
+
+void BM_DecodePacket(benchmark::State& state) {
+  boost::scoped_ptr<DecoderBenchmark> bench;
+  if (!setUp(state, DecoderBenchmark::NONE, bench)) return;
+  size_t seq = 0;
+  size_t points = 0;
+  allocation_count = 0;
+  count_allocations = true;
+  for (auto _ : state) {
+    size_t pkt_idx = seq++ % bench->packetCount();
+    bench->decodePacket(pkt_idx);
+    benchmark::ClobberMemory();
+    points += bench->pointCount(pkt_idx);
+  }
+  count_allocations = false;
+  reportPackets(state, points);
+}
+BENCHMARK(BM_DecodePacket)->Arg(SYNTHETIC)->Arg(CORPUS);
+
+void BM_ConvertFirings(benchmark::State& state) {
+  boost::scoped_ptr<DecoderBenchmark> bench;
+  if (!setUp(state, DecoderBenchmark::NONE, bench)) return;
+  size_t seq = 0;
+  size_t points = 0;
+  allocation_count = 0;
+  count_allocations = true;
+  for (auto _ : state) {
+    size_t pkt_idx = seq++ % bench->packetCount();
+    bench->convertFirings(pkt_idx);
+    benchmark::ClobberMemory();
+    points += bench->pointCount(pkt_idx);
+  }
+  count_allocations = false;
+  reportPackets(state, points);
+}
+BENCHMARK(BM_ConvertFirings)->Arg(SYNTHETIC)->Arg(CORPUS);
+
+// Assembly of the decoded packets into the outputs given by the
+// second argument, including the publication of the sweeps.
+void BM_AssemblePacket(benchmark::State& state) {
+  boost::scoped_ptr<DecoderBenchmark> bench;
+  if (!setUp(state, state.range(1), bench)) return;
+  size_t seq = 0;
+  size_t points = 0;
+  allocation_count = 0;
+  count_allocations = true;
+  for (auto _ : state) {
+    bench->assemblePacket(seq);
+    points += bench->pointCount(seq++ % bench->packetCount());
+  }
+  count_allocations = false;
+  reportPackets(state, points);
+}
+BENCHMARK(BM_AssemblePacket)
+  ->Args({SYNTHETIC, DecoderBenchmark::SWEEP})
+  ->Args({SYNTHETIC, DecoderBenchmark::POINT_CLOUD})
+  ->Args({SYNTHETIC, DecoderBenchmark::SWEEP|DecoderBenchmark::POINT_CLOUD})
+  ->Args({CORPUS, DecoderBenchmark::SWEEP|DecoderBenchmark::POINT_CLOUD});
+
+// The whole path of a packet through the callback.
+void BM_PacketCallback(benchmark::State& state) {
+  boost::scoped_ptr<DecoderBenchmark> bench;
+  if (!setUp(state, DecoderBenchmark::SWEEP|DecoderBenchmark::POINT_CLOUD,
+        bench)) return;
+  size_t seq = 0;
+  size_t points = 0;
+  allocation_count = 0;
+  count_allocations = true;
+  for (auto _ : state) {
+    bench->packetCallback(seq);
+    points += bench->pointCount(seq++ % bench->packetCount());
+  }
+  count_allocations = false;
+  reportPackets(state, points);
+}
+BENCHMARK(BM_PacketCallback)->Arg(SYNTHETIC)->Arg(CORPUS);
+
+// Publication of the point cloud of a revolution. The time of each
+// iteration is the time per sweep.
+void BM_PublishPointCloud(benchmark::State& state) {
+  boost::scoped_ptr<DecoderBenchmark> bench;
+  if (!setUp(state, DecoderBenchmark::POINT_CLOUD, bench)) return;
+  const size_t pkt_count = bench->revolutionPackets();
+  size_t sweep_points = 0;
+  for (size_t pkt_idx = 0; pkt_idx < pkt_count; ++pkt_idx)
+    sweep_points += bench->pointCount(pkt_idx);
+
+  allocation_count = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    ros::spinOnce();
+    bench->fillSweep(pkt_count);
+    count_allocations = true;
+    state.ResumeTiming();
+    bench->publishPointCloud();
+    count_allocations = false;
+  }
+  state.counters["points/s"] = benchmark::Counter(
+      state.iterations()*sweep_points, benchmark::Counter::kIsRate);
+  state.counters["allocs/sweep"] = benchmark::Counter(
+      allocation_count, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PublishPointCloud)->Arg(SYNTHETIC)->Arg(CORPUS);
+
+} // end anonymous namespace
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "velodyne_puck_benchmarks",
+      ros::init_options::AnonymousName);
+  if (!ros::master::check())
+    std::fprintf(stderr, "No ROS master, only the xyz conversion "
+        "is benchmarked.\n");
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
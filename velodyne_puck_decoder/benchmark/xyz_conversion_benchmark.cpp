@@ -0,0 +1,92 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <velodyne_puck_decoder/xyz_conversion.h>
+
+using namespace velodyne_puck_decoder;
+
+namespace {
+
+static const size_t FIRINGS = 24;
+static const size_t LASERS = 16;
+static const size_t SHOTS = FIRINGS * LASERS;
+static const double RESOLUTION = 0.002;
+
+// Shots of one packet, with the firings 0.2 degree apart
+// and random distances within the range of the sensor.
+struct Shots {
+  Shots(): distance(SHOTS), azimuth(SHOTS), x(SHOTS), y(SHOTS), z(SHOTS) {
+    srand(0);
+    for (size_t shot_idx = 0; shot_idx < SHOTS; ++shot_idx) {
+      distance[shot_idx] = static_cast<uint16_t>(rand() % 65000);
+      azimuth[shot_idx] = static_cast<uint16_t>(
+          (35000 + 20*(shot_idx/LASERS) + shot_idx%LASERS) % RAW_AZIMUTH_COUNT);
+    }
+    for (size_t laser_idx = 0; laser_idx < LASERS; ++laser_idx) {
+      double altitude = (-15.0 + 2.0*laser_idx) * M_PI / 180.0;
+      laser_factors[laser_idx].horizontal_factor = RESOLUTION*cos(altitude);
+      laser_factors[laser_idx].vertical_factor = RESOLUTION*sin(altitude);
+      fixed_laser_factors[laser_idx].horizontal_factor =
+        toFixedPoint(cos(altitude));
+      fixed_laser_factors[laser_idx].vertical_factor =
+        toFixedPoint(sin(altitude));
+    }
+  }
+
+  std::vector<uint16_t> distance;
+  std::vector<uint16_t> azimuth;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  LaserFactors<float> laser_factors[LASERS];
+  LaserFactors<int32_t> fixed_laser_factors[LASERS];
+};
+
+void BM_ConvertToXyz(benchmark::State& state) {
+  Shots shots;
+  const AzimuthVector* table = azimuthTable();
+  for (auto _ : state) {
+    convertToXyz(&shots.distance[0], &shots.azimuth[0],
+        shots.laser_factors, table,
+        FIRINGS, LASERS, &shots.x[0], &shots.y[0], &shots.z[0]);
+    benchmark::DoNotOptimize(&shots.x[0]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * SHOTS);
+}
+BENCHMARK(BM_ConvertToXyz);
+
+void BM_ConvertToXyzFixed(benchmark::State& state) {
+  Shots shots;
+  const FixedAzimuthVector* table = fixedAzimuthTable();
+  for (auto _ : state) {
+    convertToXyzFixed(&shots.distance[0], &shots.azimuth[0],
+        shots.fixed_laser_factors, table,
+        static_cast<float>(RESOLUTION),
+        FIRINGS, LASERS, &shots.x[0], &shots.y[0], &shots.z[0]);
+    benchmark::DoNotOptimize(&shots.x[0]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * SHOTS);
+}
+BENCHMARK(BM_ConvertToXyzFixed);
+
+} // end anonymous namespace
@@ -0,0 +1,66 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DECODER_CALIBRATION_H
+#define VELODYNE_PUCK_DECODER_CALIBRATION_H
+
+#include <string>
+#include <vector>
+
+namespace velodyne_puck_decoder {
+
+// Corrections of a single laser, in the convention of the
+// calibration files of the velodyne_pointcloud package.
+struct LaserCorrection {
+  LaserCorrection():
+    vert_correction(0.0),
+    rot_correction(0.0),
+    dist_correction(0.0),
+    vert_offset_correction(0.0),
+    horiz_offset_correction(0.0) {}
+
+  double vert_correction;         ///< altitude of the laser [rad]
+  double rot_correction;          ///< azimuth offset of the laser [rad]
+  double dist_correction;         ///< added to the distance [m]
+  double vert_offset_correction;  ///< vertical offset of the laser [m]
+  double horiz_offset_correction; ///< horizontal offset of the laser [m]
+};
+
+/*
+ * Per-laser calibration of a sensor. The lasers are indexed in the
+ * order they fire, i.e. by laser_id in the calibration file.
+ */
+class Calibration {
+public:
+
+  // Nominal calibration from the altitudes in the user manual.
+  void setNominal(const double* altitudes, const size_t& num_lasers);
+
+  // Read a calibration YAML file. Errors are logged,
+  // and the calibration is left unchanged.
+  bool read(const std::string& path);
+
+  // Sensor model the calibration is for, as named in the sensor
+  // traits, e.g. "VLP-16". Empty if the file does not say.
+  std::string model;
+  std::vector<LaserCorrection> lasers;
+};
+
+} // end namespace velodyne_puck_decoder
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DECODER_LATENCY_HISTOGRAM_H
+#define VELODYNE_PUCK_DECODER_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace velodyne_puck_decoder {
+
+/*
+ * Histogram of latencies, which is recorded from any thread without
+ * a lock. The bins are powers of two of a microsecond, the first bin
+ * holds the latencies below 1us and the last one all the latencies
+ * beyond 2^(BINS-2)us. The counts are moved out by collect(), which
+ * may run concurrently with record(), so a latency recorded meanwhile
+ * is counted in one of two consecutive collections.
+ */
+class LatencyHistogram : private boost::noncopyable {
+public:
+
+  static const size_t BINS = 25;
+
+  // Latencies moved out of the histogram.
+  struct Snapshot {
+    Snapshot(): count(0), sum(0), max(0) {
+      std::fill(bins, bins+BINS, 0);
+    }
+
+    // Mean of the latencies [s]
+    double mean() const {
+      return count > 0 ? sum*1e-9/count : 0.0;
+    }
+
+    // Upper bound of the bin with the given fraction of the latencies
+    // at or below it, capped at the maximum latency [s]
+    double percentile(const double& fraction) const {
+      uint64_t rank = static_cast<uint64_t>(fraction*count + 0.5);
+      uint64_t cumulative = 0;
+      for (size_t bin = 0; bin < BINS-1; ++bin) {
+        cumulative += bins[bin];
+        if (cumulative >= rank && cumulative > 0)
+          return std::min(binUpperBound(bin), max)*1e-9;
+      }
+      return max*1e-9;
+    }
+
+    uint64_t bins[BINS];
+    uint64_t count;
+    uint64_t sum;   ///< [ns]
+    uint64_t max;   ///< [ns]
+  };
+
+  // Upper bound of a bin but the last one [ns]
+  static uint64_t binUpperBound(const size_t& bin) {
+    return 1000ull << bin;
+  }
+
+  LatencyHistogram(): sum(0), max(0) {
+    for (size_t bin = 0; bin < BINS; ++bin) bins[bin].store(0);
+  }
+
+  // Negative latencies, from clocks out of sync, count as 0.
+  void record(const int64_t& latency_ns) {
+    uint64_t latency = latency_ns > 0 ? latency_ns : 0;
+    uint64_t latency_us = latency / 1000;
+    size_t bin = latency_us == 0 ? 0 : std::min<size_t>(BINS-1,
+        64 - __builtin_clzll(latency_us));
+    bins[bin].fetch_add(1, boost::memory_order_relaxed);
+    sum.fetch_add(latency, boost::memory_order_relaxed);
+    uint64_t current_max = max.load(boost::memory_order_relaxed);
+    while (latency > current_max && !max.compare_exchange_weak(
+          current_max, latency, boost::memory_order_relaxed));
+    return;
+  }
+
+  // Move the latencies recorded since the last collection
+  // into the snapshot.
+  void collect(Snapshot& snapshot) {
+    snapshot.count = 0;
+    for (size_t bin = 0; bin < BINS; ++bin) {
+      snapshot.bins[bin] = bins[bin].exchange(0, boost::memory_order_relaxed);
+      snapshot.count += snapshot.bins[bin];
+    }
+    snapshot.sum = sum.exchange(0, boost::memory_order_relaxed);
+    snapshot.max = max.exchange(0, boost::memory_order_relaxed);
+    return;
+  }
+
+private:
+
+  boost::atomic<uint64_t> bins[BINS];
+  boost::atomic<uint64_t> sum;
+  boost::atomic<uint64_t> max;
+};
+
+} // end namespace velodyne_puck_decoder
+
+#endif
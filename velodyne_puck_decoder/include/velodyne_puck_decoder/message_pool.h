@@ -0,0 +1,85 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VELODYNE_PUCK_DECODER_MESSAGE_POOL_H
+#define VELODYNE_PUCK_DECODER_MESSAGE_POOL_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+namespace velodyne_puck_decoder {
+
+/*
+ * A small pool of messages which are recycled once all the
+ * subscribers have released them. A message is back in the pool
+ * when the pool holds the only reference to it, so the large
+ * buffers within the message can be reused without allocation.
+ */
+template <typename Message>
+class MessagePool {
+public:
+
+  typedef boost::shared_ptr<Message> MessagePtr;
+
+  MessagePool(): capacity(0), exhausted_count(0) {}
+  explicit MessagePool(const size_t& c): capacity(c), exhausted_count(0) {
+    messages.reserve(capacity);
+  }
+
+  void setCapacity(const size_t& c) {
+    capacity = c;
+    messages.reserve(capacity);
+  }
+
+  // Get a message which is not used anywhere else. The returned
+  // message may still contain the data from its previous use.
+  // If all the messages in the pool are in use, a new message
+  // out of the pool is returned, and the pool counts as exhausted.
+  MessagePtr acquire() {
+    for (size_t i = 0; i < messages.size(); ++i)
+      if (messages[i].unique()) return messages[i];
+
+    MessagePtr message(new Message());
+    if (messages.size() < capacity) messages.push_back(message);
+    else ++exhausted_count;
+    return message;
+  }
+
+  // Number of messages currently held by subscribers.
+  size_t inUse() const {
+    size_t count = 0;
+    for (size_t i = 0; i < messages.size(); ++i)
+      if (!messages[i].unique()) ++count;
+    return count;
+  }
+
+  size_t size() const { return messages.size(); }
+  size_t getCapacity() const { return capacity; }
+
+  // Number of times a message had to be allocated out of the pool.
+  size_t exhaustedCount() const { return exhausted_count; }
+
+private:
+
+  size_t capacity;
+  size_t exhausted_count;
+  std::vector<MessagePtr> messages;
+};
+
+} // end namespace velodyne_puck_decoder
+
+#endif
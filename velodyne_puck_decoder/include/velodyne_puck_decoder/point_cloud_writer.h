@@ -0,0 +1,298 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VELODYNE_PUCK_DECODER_POINT_CLOUD_WRITER_H
+#define VELODYNE_PUCK_DECODER_POINT_CLOUD_WRITER_H
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+namespace velodyne_puck_decoder {
+
+// Point layouts of the published point cloud. The layout is chosen
+// at compile time (see VELODYNE_PUCK_POINT_TYPE in CMakeLists.txt),
+// so that writing a point is a plain store into the message buffer.
+struct PointXYZI {
+  float x;
+  float y;
+  float z;
+  float intensity;
+
+  void set(const float& x_, const float& y_, const float& z_,
+      const float& intensity_, const uint16_t& ring_, const float& time_) {
+    x = x_; y = y_; z = z_; intensity = intensity_;
+  }
+  void setTimestamp(const uint64_t& stamp_ns) {}
+  static void addFields(std::vector<sensor_msgs::PointField>& fields);
+};
+
+struct PointXYZIR {
+  float x;
+  float y;
+  float z;
+  float intensity;
+  uint16_t ring;
+  uint16_t padding; ///< zeroed, as the buffer of the cloud is recycled
+
+  void set(const float& x_, const float& y_, const float& z_,
+      const float& intensity_, const uint16_t& ring_, const float& time_) {
+    x = x_; y = y_; z = z_; intensity = intensity_; ring = ring_;
+    padding = 0;
+  }
+  void setTimestamp(const uint64_t& stamp_ns) {}
+  static void addFields(std::vector<sensor_msgs::PointField>& fields);
+};
+
+struct PointXYZIRT {
+  float x;
+  float y;
+  float z;
+  float intensity;
+  uint16_t ring;
+  uint16_t padding; ///< zeroed, as the buffer of the cloud is recycled
+  float time;       ///< [s] relative to the stamp of the cloud
+
+  void set(const float& x_, const float& y_, const float& z_,
+      const float& intensity_, const uint16_t& ring_, const float& time_) {
+    x = x_; y = y_; z = z_; intensity = intensity_; ring = ring_;
+    padding = 0;
+    time = time_;
+  }
+  void setTimestamp(const uint64_t& stamp_ns) {}
+  static void addFields(std::vector<sensor_msgs::PointField>& fields);
+};
+
+struct PointXYZIRTS {
+  float x;
+  float y;
+  float z;
+  float intensity;
+  uint16_t ring;
+  uint16_t padding; ///< zeroed, as the buffer of the cloud is recycled
+  float time;       ///< [s] relative to the stamp of the cloud
+  double timestamp; ///< [s] since the epoch
+
+  void set(const float& x_, const float& y_, const float& z_,
+      const float& intensity_, const uint16_t& ring_, const float& time_) {
+    x = x_; y = y_; z = z_; intensity = intensity_; ring = ring_;
+    padding = 0;
+    time = time_;
+  }
+  void setTimestamp(const uint64_t& stamp_ns) {
+    timestamp = stamp_ns * 1e-9;
+  }
+  static void addFields(std::vector<sensor_msgs::PointField>& fields);
+};
+
+inline void addPointField(std::vector<sensor_msgs::PointField>& fields,
+    const std::string& name, const uint32_t& offset, const uint8_t& datatype) {
+  sensor_msgs::PointField field;
+  field.name = name;
+  field.offset = offset;
+  field.datatype = datatype;
+  field.count = 1;
+  fields.push_back(field);
+  return;
+}
+
+inline void PointXYZI::addFields(
+    std::vector<sensor_msgs::PointField>& fields) {
+  addPointField(fields, "x", offsetof(PointXYZI, x),
+      sensor_msgs::PointField::FLOAT32);
+  addPointField(fields, "y", offsetof(PointXYZI, y),
+      sensor_msgs::PointField::FLOAT32);
+  addPointField(fields, "z", offsetof(PointXYZI, z),
+      sensor_msgs::PointField::FLOAT32);
+  addPointField(fields, "intensity", offsetof(PointXYZI, intensity),
+      sensor_msgs::PointField::FLOAT32);
+  return;
+}
+
+inline void PointXYZIR::addFields(
+    std::vector<sensor_msgs::PointField>& fields) {
+  PointXYZI::addFields(fields);
+  addPointField(fields, "ring", offsetof(PointXYZIR, ring),
+      sensor_msgs::PointField::UINT16);
+  return;
+}
+
+inline void PointXYZIRT::addFields(
+    std::vector<sensor_msgs::PointField>& fields) {
+  PointXYZIR::addFields(fields);
+  addPointField(fields, "time", offsetof(PointXYZIRT, time),
+      sensor_msgs::PointField::FLOAT32);
+  return;
+}
+
+inline void PointXYZIRTS::addFields(
+    std::vector<sensor_msgs::PointField>& fields) {
+  PointXYZIR::addFields(fields);
+  addPointField(fields, "time", offsetof(PointXYZIRTS, time),
+      sensor_msgs::PointField::FLOAT32);
+  addPointField(fields, "timestamp", offsetof(PointXYZIRTS, timestamp),
+      sensor_msgs::PointField::FLOAT64);
+  return;
+}
+
+#if defined(VELODYNE_PUCK_POINT_XYZIRTS)
+typedef PointXYZIRTS CloudPoint;
+#elif defined(VELODYNE_PUCK_POINT_XYZIRT)
+typedef PointXYZIRT CloudPoint;
+#elif defined(VELODYNE_PUCK_POINT_XYZIR)
+typedef PointXYZIR CloudPoint;
+#else
+typedef PointXYZI CloudPoint;
+#endif
+
+/*
+ * Writes points directly into the data buffer of a PointCloud2.
+ * The buffer is split into one slab per ring, so the points can be
+ * added in the order of decoding while the published cloud is
+ * still ordered by ring. The buffer is sized once, so a recycled
+ * cloud message is filled without any allocation.
+ *
+ * In the organized mode, the buffer is a grid with one row per ring
+ * and one column per azimuth bin instead, where the bins without
+ * a valid return are NaN.
+ */
+template <typename Point>
+class PointCloudWriter {
+public:
+
+  PointCloudWriter():
+    cloud(NULL), organized(false), rings(0), ring_capacity(0) {}
+
+  // Start writing an unorganized cloud into the given message.
+  void reset(sensor_msgs::PointCloud2& new_cloud,
+      const size_t& num_rings, const size_t& capacity) {
+    organized = false;
+    rings = num_rings;
+    ring_capacity = capacity;
+    ring_sizes.assign(rings, 0);
+    prepare(new_cloud);
+    return;
+  }
+
+  // Start writing an organized cloud of num_rings x columns points
+  // into the given message. All the points are initialized to NaN.
+  void resetOrganized(sensor_msgs::PointCloud2& new_cloud,
+      const size_t& num_rings, const size_t& columns) {
+    organized = true;
+    rings = num_rings;
+    ring_capacity = columns;
+    ring_sizes.assign(rings, columns);
+    prepare(new_cloud);
+
+    Point nan_point;
+    std::memset(&nan_point, 0, sizeof(Point));
+    nan_point.x = std::numeric_limits<float>::quiet_NaN();
+    nan_point.y = std::numeric_limits<float>::quiet_NaN();
+    nan_point.z = std::numeric_limits<float>::quiet_NaN();
+    if (!cloud->data.empty()) {
+      Point* points = reinterpret_cast<Point*>(&cloud->data[0]);
+      std::fill(points, points+rings*ring_capacity, nan_point);
+    }
+    return;
+  }
+
+  // Get the storage for a new point in the given ring.
+  Point& add(const size_t& ring) {
+    if (ring_sizes[ring] == ring_capacity) grow();
+    Point* slab = reinterpret_cast<Point*>(&cloud->data[0]) +
+      ring * ring_capacity;
+    return slab[ring_sizes[ring]++];
+  }
+
+  // Get the point in the given ring and column of an organized cloud.
+  Point& at(const size_t& ring, const size_t& column) {
+    return reinterpret_cast<Point*>(&cloud->data[0])[
+      ring*ring_capacity + column];
+  }
+
+  // Finish the cloud. For an unorganized cloud, the slabs are packed
+  // into a contiguous buffer, dropping end_points at both ends of
+  // each ring.
+  void finish(const size_t& end_points = 0) {
+    if (organized) {
+      cloud->height = rings;
+      cloud->width = ring_capacity;
+      cloud->row_step = ring_capacity * sizeof(Point);
+      cloud->is_dense = false;
+      return;
+    }
+
+    uint8_t* data = cloud->data.empty() ? NULL : &cloud->data[0];
+    size_t width = 0;
+    for (size_t ring = 0; ring < rings; ++ring) {
+      if (ring_sizes[ring] <= 2*end_points) continue;
+      size_t count = ring_sizes[ring] - 2*end_points;
+      std::memmove(data + width*sizeof(Point),
+          data + (ring*ring_capacity+end_points)*sizeof(Point),
+          count*sizeof(Point));
+      width += count;
+    }
+
+    cloud->height = 1;
+    cloud->width = width;
+    cloud->row_step = width * sizeof(Point);
+    cloud->is_dense = true;
+    cloud->data.resize(cloud->row_step);
+    return;
+  }
+
+private:
+
+  void prepare(sensor_msgs::PointCloud2& new_cloud) {
+    cloud = &new_cloud;
+    cloud->fields.clear();
+    Point::addFields(cloud->fields);
+    cloud->is_bigendian = false;
+    cloud->point_step = sizeof(Point);
+    cloud->data.resize(rings * ring_capacity * sizeof(Point));
+    return;
+  }
+
+  // Double the capacity of each ring, moving the slabs in place.
+  void grow() {
+    size_t new_capacity = ring_capacity > 0 ? 2*ring_capacity : 1;
+    cloud->data.resize(rings * new_capacity * sizeof(Point));
+    uint8_t* data = &cloud->data[0];
+    for (size_t ring = rings; ring-- > 1; )
+      std::memmove(data + ring*new_capacity*sizeof(Point),
+          data + ring*ring_capacity*sizeof(Point),
+          ring_sizes[ring]*sizeof(Point));
+    ring_capacity = new_capacity;
+    return;
+  }
+
+  sensor_msgs::PointCloud2* cloud;
+  bool organized;
+  size_t rings;
+  size_t ring_capacity;
+  std::vector<size_t> ring_sizes;
+};
+
+} // end namespace velodyne_puck_decoder
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DECODER_RANGE_IMAGE_CODEC_H
+#define VELODYNE_PUCK_DECODER_RANGE_IMAGE_CODEC_H
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#include <velodyne_puck_msgs/VelodynePuckCompressedRangeImage.h>
+#include <velodyne_puck_msgs/VelodynePuckRangeImage.h>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace velodyne_puck_decoder {
+
+/*
+ * Lossless codec of the range images for narrow links. The azimuth
+ * of the columns, and the range and intensity along each row, are
+ * delta coded, since neighbouring readings are mostly close. The
+ * 16-bit deltas are split into a plane of low bytes and a plane of
+ * high bytes, which are mostly zero, and the result is compressed
+ * with zstd. The time of the columns is stored as it is.
+ *
+ * The codec keeps its buffers and zstd contexts between the images,
+ * so a codec should not be shared between threads.
+ */
+class RangeImageCodec : boost::noncopyable {
+public:
+
+  static const char* const FORMAT;
+
+  RangeImageCodec();
+  ~RangeImageCodec();
+
+  // The zstd compression level, 1 (fastest) by default.
+  void setLevel(const int& new_level) { level = new_level; }
+
+  bool encode(const velodyne_puck_msgs::VelodynePuckRangeImage& image,
+      velodyne_puck_msgs::VelodynePuckCompressedRangeImage& compressed);
+  bool decode(
+      const velodyne_puck_msgs::VelodynePuckCompressedRangeImage& compressed,
+      velodyne_puck_msgs::VelodynePuckRangeImage& image);
+
+private:
+
+  int level;
+  ZSTD_CCtx_s* cctx;
+  ZSTD_DCtx_s* dctx;
+  std::vector<uint8_t> buffer;
+};
+
+} // end namespace velodyne_puck_decoder
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DECODER_SENSOR_TRAITS_H
+#define VELODYNE_PUCK_DECODER_SENSOR_TRAITS_H
+
+#include <cmath>
+#include <stdint.h>
+
+namespace velodyne_puck_decoder {
+
+// Timing shared by the supported sensors.
+static const double  DSR_TOFFSET       = 2.304;   // [µs]
+static const double  FIRING_TOFFSET    = 55.296;  // [µs]
+
+// Largest number of lasers of the supported sensors.
+static const int MAX_LASERS = 32;
+
+// Product IDs in the second factory byte of the data packets.
+// The Puck LITE reports the ID of the VLP-16, and has the
+// same geometry and timing.
+enum SensorModel {
+  UNKNOWN_SENSOR = 0x00,
+  VLP16          = 0x22,
+  PUCK_HI_RES    = 0x24,
+  VLP32C         = 0x28
+};
+
+/*
+ * Geometry and timing of each sensor model. The lasers are indexed in
+ * the order of the data within a firing. LASERS is a compile time
+ * constant, so the decode loops can be specialized for each model.
+ */
+struct VLP16Traits {
+  static const SensorModel MODEL = VLP16;
+  static const int LASERS = 16;
+  static const char* name() { return "VLP-16"; }
+
+  // Nominal altitude of each laser [deg].
+  static double altitude(const int& laser) {
+    static const double altitudes[LASERS] = {
+      -15.0,  1.0, -13.0,  3.0, -11.0,  5.0,  -9.0,  7.0,
+       -7.0,  9.0,  -5.0, 11.0,  -3.0, 13.0,  -1.0, 15.0
+    };
+    return altitudes[laser];
+  }
+
+  // The lasers fire one after another.
+  static double timeOffset(const int& laser) {
+    return laser * DSR_TOFFSET;
+  }
+};
+
+struct PuckHiResTraits {
+  static const SensorModel MODEL = PUCK_HI_RES;
+  static const int LASERS = 16;
+  static const char* name() { return "Puck Hi-Res"; }
+
+  static double altitude(const int& laser) {
+    static const double altitudes[LASERS] = {
+      -10.00,  0.67, -8.67,  2.00, -7.33,  3.33, -6.00,  4.67,
+       -4.67,  6.00, -3.33,  7.33, -2.00,  8.67, -0.67, 10.00
+    };
+    return altitudes[laser];
+  }
+
+  static double timeOffset(const int& laser) {
+    return laser * DSR_TOFFSET;
+  }
+};
+
+struct VLP32CTraits {
+  static const SensorModel MODEL = VLP32C;
+  static const int LASERS = 32;
+  static const char* name() { return "VLP-32C"; }
+
+  // The lasers are also offset in azimuth. These offsets are
+  // not included here, and come from the calibration file.
+  static double altitude(const int& laser) {
+    static const double altitudes[LASERS] = {
+      -25.0,   -1.0,   -1.667, -15.639, -11.31,   0.0,   -0.667, -8.843,
+       -7.254,  0.333, -0.333,  -6.148,  -5.333,  1.333,  0.667, -4.0,
+       -4.667,  1.667,  1.0,    -3.667,  -3.333,  3.333,  2.333, -2.667,
+       -3.0,    7.0,    4.667,  -2.333,  -2.0,   15.0,   10.333, -1.333
+    };
+    return altitudes[laser];
+  }
+
+  // The lasers fire in pairs.
+  static double timeOffset(const int& laser) {
+    return (laser/2) * DSR_TOFFSET;
+  }
+};
+
+// Run time description of a sensor model.
+struct SensorInfo {
+  SensorInfo(): model(UNKNOWN_SENSOR), name("unknown"), lasers(0) {}
+
+  SensorModel model;
+  const char* name;
+  int lasers;
+  double altitude[MAX_LASERS];     ///< [rad]
+  double time_offset[MAX_LASERS];  ///< within a firing [µs]
+};
+
+template <typename Traits>
+SensorInfo getSensorInfo() {
+  SensorInfo info;
+  info.model = Traits::MODEL;
+  info.name = Traits::name();
+  info.lasers = Traits::LASERS;
+  for (int laser = 0; laser < Traits::LASERS; ++laser) {
+    info.altitude[laser] = Traits::altitude(laser) * M_PI / 180.0;
+    info.time_offset[laser] = Traits::timeOffset(laser);
+  }
+  return info;
+}
+
+// Description of the sensor with the given product ID.
+// Returns false if the model is not supported.
+inline bool getSensorInfo(const uint8_t& product_id, SensorInfo& info) {
+  switch (product_id) {
+    case VLP16:       info = getSensorInfo<VLP16Traits>();     return true;
+    case PUCK_HI_RES: info = getSensorInfo<PuckHiResTraits>(); return true;
+    case VLP32C:      info = getSensorInfo<VLP32CTraits>();    return true;
+    default:          return false;
+  }
+}
+
+} // end namespace velodyne_puck_decoder
+
+#endif
@@ -24,20 +24,34 @@
 #include <cmath>
 #include <vector>
 #include <string>
+#include <deque>
+#include <boost/atomic.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <tf/transform_listener.h>
 
-#include <pcl_conversions/pcl_conversions.h>
-#include <pcl_ros/point_cloud.h>
-#include <pcl/point_types.h>
-
+#include <velodyne_puck_msgs/VelodynePuckCompressedRangeImage.h>
+#include <velodyne_puck_msgs/VelodynePuckLatencyReport.h>
 #include <velodyne_puck_msgs/VelodynePuckPacket.h>
 #include <velodyne_puck_msgs/VelodynePuckPoint.h>
+#include <velodyne_puck_msgs/VelodynePuckRangeImage.h>
 #include <velodyne_puck_msgs/VelodynePuckScan.h>
+#include <velodyne_puck_msgs/VelodynePuckSector.h>
 #include <velodyne_puck_msgs/VelodynePuckSweep.h>
 
+#include <velodyne_puck_decoder/calibration.h>
+#include <velodyne_puck_decoder/latency_histogram.h>
+#include <velodyne_puck_decoder/message_pool.h>
+#include <velodyne_puck_decoder/point_cloud_writer.h>
+#include <velodyne_puck_decoder/range_image_codec.h>
+#include <velodyne_puck_decoder/sensor_traits.h>
+#include <velodyne_puck_decoder/voxel_grid.h>
+#include <velodyne_puck_decoder/xyz_conversion.h>
+
 
 namespace velodyne_puck_decoder {
 
@@ -59,54 +73,20 @@ static const double DISTANCE_MAX_UNITS  =
 static const uint16_t UPPER_BANK = 0xeeff;
 static const uint16_t LOWER_BANK = 0xddff;
 
-/** Special Defines for VLP16 support **/
-static const int     FIRINGS_PER_BLOCK = 2;
-static const int     SCANS_PER_FIRING  = 16;
-static const double  BLOCK_TDURATION   = 110.592; // [µs]
-static const double  DSR_TOFFSET       = 2.304;   // [µs]
-static const double  FIRING_TOFFSET    = 55.296;  // [µs]
+// Return mode in the first factory byte of the data packets. In dual
+// return mode, each pair of blocks holds two returns of the same firings.
+static const uint8_t DUAL_RETURN = 0x39;
 
 static const int PACKET_SIZE        = 1206;
 static const int BLOCKS_PER_PACKET  = 12;
 static const int PACKET_STATUS_SIZE = 4;
 static const int SCANS_PER_PACKET =
   (SCANS_PER_BLOCK * BLOCKS_PER_PACKET);
-static const int FIRINGS_PER_PACKET =
-  FIRINGS_PER_BLOCK * BLOCKS_PER_PACKET;
-
-// Pre-compute the sine and cosine for the altitude angles.
-static const double scan_altitude[16] = {
-  -0.2617993877991494,   0.017453292519943295,
-  -0.22689280275926285,  0.05235987755982989,
-  -0.19198621771937624,  0.08726646259971647,
-  -0.15707963267948966,  0.12217304763960307,
-  -0.12217304763960307,  0.15707963267948966,
-  -0.08726646259971647,  0.19198621771937624,
-  -0.05235987755982989,  0.22689280275926285,
-  -0.017453292519943295, 0.2617993877991494
-};
-
-static const double cos_scan_altitude[16] = {
-  std::cos(scan_altitude[ 0]), std::cos(scan_altitude[ 1]),
-  std::cos(scan_altitude[ 2]), std::cos(scan_altitude[ 3]),
-  std::cos(scan_altitude[ 4]), std::cos(scan_altitude[ 5]),
-  std::cos(scan_altitude[ 6]), std::cos(scan_altitude[ 7]),
-  std::cos(scan_altitude[ 8]), std::cos(scan_altitude[ 9]),
-  std::cos(scan_altitude[10]), std::cos(scan_altitude[11]),
-  std::cos(scan_altitude[12]), std::cos(scan_altitude[13]),
-  std::cos(scan_altitude[14]), std::cos(scan_altitude[15]),
-};
+// The 16 laser sensors fire twice per block, the 32 laser sensors once.
+static const int MAX_FIRINGS_PER_PACKET = 2 * BLOCKS_PER_PACKET;
 
-static const double sin_scan_altitude[16] = {
-  std::sin(scan_altitude[ 0]), std::sin(scan_altitude[ 1]),
-  std::sin(scan_altitude[ 2]), std::sin(scan_altitude[ 3]),
-  std::sin(scan_altitude[ 4]), std::sin(scan_altitude[ 5]),
-  std::sin(scan_altitude[ 6]), std::sin(scan_altitude[ 7]),
-  std::sin(scan_altitude[ 8]), std::sin(scan_altitude[ 9]),
-  std::sin(scan_altitude[10]), std::sin(scan_altitude[11]),
-  std::sin(scan_altitude[12]), std::sin(scan_altitude[13]),
-  std::sin(scan_altitude[14]), std::sin(scan_altitude[15]),
-};
+// Number of packets in flight per decode thread.
+static const int PIPELINE_SLOTS_PER_THREAD = 4;
 
 class VelodynePuckDecoder {
 public:
@@ -114,14 +94,14 @@ public:
   VelodynePuckDecoder(ros::NodeHandle& n, ros::NodeHandle& pn);
   VelodynePuckDecoder(const VelodynePuckDecoder&) = delete;
   VelodynePuckDecoder operator=(const VelodynePuckDecoder&) = delete;
-  ~VelodynePuckDecoder() {return;}
+  ~VelodynePuckDecoder();
 
   bool initialize();
 
   typedef boost::shared_ptr<VelodynePuckDecoder> VelodynePuckDecoderPtr;
   typedef boost::shared_ptr<const VelodynePuckDecoder> VelodynePuckDecoderConstPtr;
 
-private:
+protected:
 
   union TwoBytes {
     uint16_t distance;
@@ -142,12 +122,88 @@ private:
     //uint8_t status[PACKET_STATUS_SIZE];
   };
 
-  struct Firing {
-    // Azimuth associated with the first shot within this firing.
-    double firing_azimuth;
-    double azimuth[SCANS_PER_FIRING];
-    double distance[SCANS_PER_FIRING];
-    double intensity[SCANS_PER_FIRING];
+  // Decoded content of one packet in structure-of-arrays form. The
+  // shots are indexed by fir_idx*lasers+scan_idx. Distances
+  // and azimuths are kept in the raw 2mm and 0.01 degree units, so the
+  // whole working set stays within L1 and each array is aligned for
+  // vector loads.
+  struct FiringBuffer {
+    // Azimuth associated with the first shot within each firing.
+    alignas(16) uint16_t firing_azimuth[MAX_FIRINGS_PER_PACKET];
+    alignas(16) uint16_t azimuth[SCANS_PER_PACKET];  ///< 0-35999
+    alignas(16) uint16_t distance[SCANS_PER_PACKET]; ///< [DISTANCE_RESOLUTION]
+    alignas(16) uint8_t intensity[SCANS_PER_PACKET];
+    alignas(16) uint8_t ground[SCANS_PER_PACKET];    ///< ground label
+    // Coordinates of the shots in the sensor frame [m].
+    alignas(16) float x[SCANS_PER_PACKET];
+    alignas(16) float y[SCANS_PER_PACKET];
+    alignas(16) float z[SCANS_PER_PACKET];
+    bool has_xyz;
+  };
+
+  // The stages of the packets below are protected, so that the
+  // benchmarks in benchmark/decoder_benchmark.cpp can drive them
+  // one at a time from a subclass.
+
+  // Callback function for a single velodyne packet.
+  void packetCallback(const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg);
+
+  // Set up the decoder for the sensor model of the first packet.
+  bool configureSensor(const velodyne_puck_msgs::VelodynePuckPacket& msg);
+  const SensorInfo& sensorInfo() const { return sensor; }
+
+  // Decode stage, which can run on several threads concurrently.
+  bool checkPacketValidity(const RawPacket* packet);
+  template <typename Traits>
+  void decodePacket(const RawPacket* packet, FiringBuffer& firings);
+  void convertFirings(FiringBuffer& firings);
+  bool processPacket(const velodyne_puck_msgs::VelodynePuckPacket& msg,
+      FiringBuffer& firings);
+
+  // Sweep assembly, which handles the packets in order.
+  void assemblePacket(FiringBuffer& firings,
+      const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg);
+  void resetSweep();
+  void fillSweep(FiringBuffer& firings,
+      const size_t& start_fir_idx, const size_t& end_fir_idx);
+  // Start an empty sweep at the given stamp [ns since the epoch].
+  void startSweep(const uint64_t& stamp_ns) {
+    resetSweep();
+    sweep_start_ns = stamp_ns;
+    packet_start_offset = 0;
+    return;
+  }
+  size_t firingsPerPacket() const { return firings_per_packet; }
+  void publishPointCloud();
+
+  // Check if a point is in the required range.
+  bool isPointInRange(const uint16_t& raw_distance) {
+    return (raw_distance >= min_range_units &&
+        raw_distance <= max_range_units);
+  }
+
+private:
+
+  // A packet in the decode pipeline. Slots are used in the order of
+  // the packet sequence, so the assembly stage can restore the order.
+  struct PacketSlot {
+    enum State {FREE, QUEUED, DECODED};
+    PacketSlot(): valid(false), state(FREE) {}
+
+    velodyne_puck_msgs::VelodynePuckPacketConstPtr msg;
+    FiringBuffer firings;
+    bool valid;
+    State state;
+  };
+
+  // Stages of the pipeline whose latency is traced.
+  enum LatencyStage {
+    RECEIVE_TO_CALLBACK,    ///< driver and transport of the packet
+    DECODE,                 ///< processPacket
+    ASSEMBLY,               ///< assemblePacket, without publishing
+    SWEEP_PUBLISH,          ///< publishSweep
+    END_TO_END,             ///< from the socket to the sweep published
+    LATENCY_STAGES
   };
 
   // Intialization sequence
@@ -155,39 +211,168 @@ private:
   bool createRosIO();
 
 
-  // Callback function for a single velodyne packet.
-  bool checkPacketValidity(const RawPacket* packet);
-  void decodePacket(const RawPacket* packet);
-  void packetCallback(const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg);
+  // Callbacks of the timers.
+  void flushCallback(const ros::TimerEvent& event);
+  void latencyCallback(const ros::TimerEvent& event);
+
+  // Conversion to xyz with the calibration of the lasers.
+  void computeLaserFactors();
+  template <typename Traits>
+  void convertPacket(FiringBuffer& firings);
+
+  // Sweep assembly internals.
+  void assembleFirings(FiringBuffer& firings,
+      const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg);
+  void updateOutputs();
+  void resetRangeImage();
+  void fillRangeImage(const FiringBuffer& firings,
+      const size_t& start_fir_idx, const size_t& end_fir_idx);
+  void updateSector(const FiringBuffer& firings,
+      const size_t& fir_idx, const uint32_t& firing_offset);
+  void deskewFirings(FiringBuffer& firings,
+      const size_t& start_fir_idx, const size_t& end_fir_idx);
+  void lookupSensorPose(const ros::Time& time, tf::StampedTransform& pose);
+  void labelGround(FiringBuffer& firings,
+      const size_t& start_fir_idx, const size_t& end_fir_idx);
+
+  // Thread functions of the decode pipeline.
+  void decodeLoop();
+  void assembleLoop();
+  void compressLoop();
 
   // Publish data
-  void publishPointCloud();
+  void publishSweep();
+  void publishRangeImage();
+  void publishSector();
+  void publishVoxelCloud();
+  void publishGroundClouds();
+
+  // Diagnostics
+  void sweepPoolDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+  void groundDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+  void deskewDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+  void compressionDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+  void timingDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+  void assemblyDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+  void latencyDiagnostics(
+      diagnostic_updater::DiagnosticStatusWrapper& status);
+
+  void recordLatency(const LatencyStage& stage, const int64_t& latency_ns) {
+    if (trace_latency) latency_histograms[stage].record(latency_ns);
+    return;
+  }
 
-  // Check if a point is in the required range.
-  bool isPointInRange(const double& distance) {
-    return (distance >= min_range && distance <= max_range);
+  // Stamp of a sweep, snapped to the phase lock if enabled.
+  uint64_t sweepStamp(const uint64_t& stamp_ns);
+
+  // Azimuth from the cut of the sweeps, so that it only decreases
+  // where a new sweep begins.
+  uint16_t cutRelativeAzimuth(const uint16_t& raw_azimuth) {
+    return raw_azimuth >= cut_azimuth ? raw_azimuth - cut_azimuth :
+      raw_azimuth + RAW_AZIMUTH_COUNT - cut_azimuth;
   }
 
-  double rawAzimuthToDouble(const uint16_t& raw_azimuth) {
+  // Azimuth bin of a point in the organized point cloud.
+  size_t azimuthToColumn(const uint16_t& raw_azimuth) {
+    return raw_azimuth * cloud_columns / RAW_AZIMUTH_COUNT;
+  }
+
+  double rawAzimuthToFloat(const uint16_t& raw_azimuth) {
     // According to the user manual,
     // azimuth = raw_azimuth / 100.0;
-    return static_cast<double>(raw_azimuth) / 100.0 * DEG_TO_RAD;
+    return raw_azimuth * RAW_AZIMUTH_TO_RAD;
   }
 
   // Configuration parameters
   double min_range;
   double max_range;
+  uint16_t min_range_units;
+  uint16_t max_range_units;
   double frequency;
   bool publish_point_cloud;
-
-  double cos_azimuth_table[6300];
-  double sin_azimuth_table[6300];
+  bool organized_point_cloud;
+  bool publish_range_image;
+  double sector_angle;
+  double voxel_leaf_size;
+  bool segment_ground;
+  double sensor_height;
+  double ground_max_slope;
+  int decode_threads;
+  int sweep_pool_size;
+
+  // Outputs with subscribers, updated at the start of each sweep.
+  // Only these are computed, and the decode stage skips the xyz
+  // conversion if none of them needs it.
+  bool sweep_enabled;
+  bool point_cloud_enabled;
+  bool range_image_enabled;
+  bool compressed_range_image_enabled;
+  bool sector_enabled;
+  bool voxel_cloud_enabled;
+  bool ground_enabled;
+  bool xyz_enabled;
+  boost::atomic<bool> convert_xyz;
+
+  std::string calibration_file;
+  Calibration calibration;
+
+  // The sensor model and return mode are detected from the first
+  // packet. The number of lasers and firings per packet are fixed
+  // afterwards, and the ring of each laser is its rank by altitude.
+  // In dual return mode, the two returns of each firing are buffered
+  // as consecutive firings, so firings_per_packet counts both.
+  SensorInfo sensor;
+  bool sensor_configured;
+  size_t lasers;
+  size_t returns_per_firing;
+  size_t firings_per_packet;
+  std::vector<size_t> laser_rings;
+  std::vector<size_t> ring_lasers;
+
+  // Unit vectors indexed by the raw azimuth, shared by all decoders,
+  // and the conversion factors of each laser with the calibration
+  // folded in.
+#ifdef VELODYNE_PUCK_FIXED_POINT
+  const FixedAzimuthVector* azimuth_table;
+  LaserFactors<int32_t> laser_factors[MAX_LASERS];
+#else
+  const AzimuthVector* azimuth_table;
+  LaserFactors<float> laser_factors[MAX_LASERS];
+#endif
+  // Fraction of the azimuth step between firings at each shot (Q14).
+  int32_t shot_azimuth_fraction[MAX_LASERS];
+  // Rotation correction of each laser in raw azimuth units.
+  int32_t laser_azimuth_offset[MAX_LASERS];
+  // Time of each firing from the first firing of a packet, and
+  // of each shot from the start of its firing [ns].
+  uint32_t firing_time_offset[MAX_FIRINGS_PER_PACKET+1];
+  uint32_t laser_time_offset[MAX_LASERS];
 
   bool is_first_sweep;
-  double last_azimuth;
-  double sweep_start_time;
-  double packet_start_time;
-  Firing firings[FIRINGS_PER_PACKET];
+  uint16_t last_azimuth;
+  // Start of the sweep [ns since the epoch], and the offset of
+  // the next firing to be assembled from it [ns].
+  uint64_t sweep_start_ns;
+  uint32_t packet_start_offset;
+  FiringBuffer firings;
+
+  // Decode pipeline
+  boost::mutex pipeline_mutex;
+  boost::condition_variable packet_queued;
+  boost::condition_variable packet_decoded;
+  boost::condition_variable slot_freed;
+  boost::thread_group pipeline_threads;
+  std::vector<PacketSlot> pipeline_slots;
+  std::deque<size_t> pending_packets;
+  bool pipeline_running;
+  size_t next_packet_seq;
+  size_t next_assembled_seq;
 
   // ROS related parameters
   ros::NodeHandle nh;
@@ -196,12 +381,164 @@ private:
   std::string fixed_frame_id;
   std::string child_frame_id;
 
+  // Motion compensation. The points are moved to the pose of the
+  // sensor at the start of the sweep, with the poses from tf. The
+  // assembly never waits for tf, and falls back to the latest pose
+  // for the times tf does not cover yet. Both cases are counted
+  // since the last diagnostics update.
+  bool deskew;
+  boost::shared_ptr<tf::TransformListener> tf_listener;
+  bool deskew_reference_valid;
+  tf::Transform deskew_reference_inverse;
+  size_t latest_deskew_poses;
+  size_t skipped_deskew_packets;
+
+  // The sweeps are recycled once all subscribers release them.
+  MessagePool<velodyne_puck_msgs::VelodynePuckSweep> sweep_pool;
+  // Exhaustion of each pool of output messages at the last diagnostics
+  // update, in the order of sweepPoolDiagnostics().
+  static const size_t OUTPUT_POOLS = 7;
+  std::vector<size_t> reported_exhausted_counts;
   velodyne_puck_msgs::VelodynePuckSweepPtr sweep_data;
-  sensor_msgs::PointCloud2 point_cloud_data;
+  // Number of points filled in each scan of sweep_data. The point
+  // vectors are sized once per sweep and filled by index.
+  std::vector<size_t> scan_sizes;
+  size_t max_points_per_scan;
+  size_t sweep_allocations;
+  // The point cloud is written while the sweep is assembled.
+  MessagePool<sensor_msgs::PointCloud2> cloud_pool;
+  sensor_msgs::PointCloud2Ptr point_cloud;
+  PointCloudWriter<CloudPoint> cloud_writer;
+  size_t cloud_columns;
+
+  // The range image is filled with a row stride of range_image_capacity
+  // columns, and the rows are packed before it is published.
+  MessagePool<velodyne_puck_msgs::VelodynePuckRangeImage> range_image_pool;
+  velodyne_puck_msgs::VelodynePuckRangeImagePtr range_image;
+
+  // Compression of the range images on a thread of its own. Only the
+  // latest range image waits for the thread, an older one is dropped.
+  // The statistics since the last diagnostics update are guarded by
+  // compression_mutex as well.
+  int compression_level;
+  RangeImageCodec range_image_codec;
+  MessagePool<velodyne_puck_msgs::VelodynePuckCompressedRangeImage>
+    compressed_range_image_pool;
+  boost::thread compression_thread;
+  boost::mutex compression_mutex;
+  boost::condition_variable range_image_queued;
+  bool compression_running;
+  velodyne_puck_msgs::VelodynePuckRangeImageConstPtr pending_range_image;
+  size_t compressed_images;
+  size_t dropped_images;
+  size_t uncompressed_bytes;
+  size_t compressed_bytes;
+  double encode_time;
+  double max_encode_time;
+  size_t range_image_width;
+  size_t range_image_capacity;
+
+  // The current sector, which is published once a firing
+  // falls into the next sector.
+  MessagePool<velodyne_puck_msgs::VelodynePuckSector> sector_pool;
+  velodyne_puck_msgs::VelodynePuckSectorPtr sector;
+  PointCloudWriter<CloudPoint> sector_writer;
+  size_t sectors_per_sweep;
+  float sectors_per_raw_azimuth;
+  size_t sector_capacity;
+  uint32_t sector_start_offset;
+
+  // Downsampled point cloud, with the points averaged per voxel
+  // while the sweep is assembled.
+  VoxelGrid voxel_grid;
+  MessagePool<sensor_msgs::PointCloud2> voxel_cloud_pool;
+  PointCloudWriter<PointXYZI> voxel_writer;
+
+  // Ground segmentation. The points of each firing are walked up
+  // from the lowest ring, and stay on the ground as long as the slope
+  // to the previous point is small enough.
+  float ground_slope_tan;
+  MessagePool<sensor_msgs::PointCloud2> ground_cloud_pool;
+  sensor_msgs::PointCloud2Ptr ground_cloud;
+  sensor_msgs::PointCloud2Ptr obstacle_cloud;
+  PointCloudWriter<CloudPoint> ground_writer;
+  PointCloudWriter<CloudPoint> obstacle_writer;
+  double ground_time;
+  size_t ground_points;
+  double last_ground_time;
+  size_t last_ground_points;
+  size_t last_obstacle_points;
+
+  // Sweep cut. The sweeps start where the sensor passes cut_azimuth.
+  // With the phase lock, the stamps of the sweeps are snapped to the
+  // rotation period from the top of each second.
+  double cut_angle;
+  bool phase_lock;
+  uint16_t cut_azimuth;
+  uint64_t rotation_period_ns;
+  // Latency from the last firing of each sweep to its publication,
+  // and the phase of the sweeps, since the last diagnostics update.
+  double latency_sum;
+  double latency_max;
+  size_t latency_count;
+  int64_t phase_error_max;
+  size_t unlocked_sweeps;
+
+  // Loss-tolerant assembly. Lost packets are detected from the
+  // azimuth gap to the previous packet. A sweep is also closed once
+  // it spans sweep_timeout on the clock of the sensor, or if no
+  // packet arrives within sweep_timeout, which bounds its storage.
+  // The assembly is guarded by assembly_mutex against the timer.
+  double sweep_timeout;
+  uint64_t sweep_timeout_ns;
+  size_t max_sweep_firings;
+  boost::mutex assembly_mutex;
+  ros::Timer flush_timer;
+  // ROS time the last packet was assembled at, which the flush timer
+  // runs on. The stamps of replayed packets may be long past.
+  uint64_t last_arrival_ns;
+  bool sweep_flushed;
+  float azimuth_per_firing;
+  size_t sweep_firings;
+  // Assembly statistics since the last diagnostics update.
+  size_t missing_firings;
+  size_t incomplete_sweeps;
+  size_t timed_out_sweeps;
+  size_t flushed_sweeps;
+  float min_completeness;
+
+  // Latency tracing. The stamp of each packet is the time the driver
+  // read it from the socket, and the latency of each stage is
+  // recorded in a histogram. The histograms are moved into a report
+  // every latency_report_period, which is published and kept for the
+  // diagnostics under latency_mutex.
+  double latency_report_period;
+  bool trace_latency;
+  LatencyHistogram latency_histograms[LATENCY_STAGES];
+  ros::Timer latency_timer;
+  boost::mutex latency_mutex;
+  velodyne_puck_msgs::VelodynePuckLatencyReport latency_report;
+  // Time spent in publishSweep within the assembly of a packet [ns],
+  // and if a sweep has been published meanwhile.
+  int64_t sweep_publish_ns;
+  bool sweep_published;
+  // Sequence numbers of the packets and sweeps in the tracepoints.
+  uint64_t received_packets;
+  uint64_t published_sweeps;
 
   ros::Subscriber packet_sub;
   ros::Publisher sweep_pub;
   ros::Publisher point_cloud_pub;
+  ros::Publisher range_image_pub;
+  ros::Publisher compressed_range_image_pub;
+  ros::Publisher sector_pub;
+  ros::Publisher voxel_cloud_pub;
+  ros::Publisher ground_cloud_pub;
+  ros::Publisher obstacle_cloud_pub;
+  ros::Publisher latency_pub;
+
+  // Diagnostics updater
+  diagnostic_updater::Updater diagnostics;
 
 };
 
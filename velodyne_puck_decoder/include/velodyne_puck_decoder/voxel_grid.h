@@ -0,0 +1,165 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DECODER_VOXEL_GRID_H
+#define VELODYNE_PUCK_DECODER_VOXEL_GRID_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+namespace velodyne_puck_decoder {
+
+/*
+ * Streaming voxel grid for downsampling. The points are averaged per
+ * voxel in an open addressing hash table with a fixed capacity, which
+ * is allocated once. Instead of clearing the table for each sweep,
+ * the voxels are tagged with the generation of the sweep, and the
+ * voxels of older generations count as empty.
+ */
+class VoxelGrid {
+public:
+
+  struct Voxel {
+    Voxel(): key(0), generation(0), count(0),
+      x(0.0f), y(0.0f), z(0.0f), intensity(0.0f) {}
+
+    uint64_t key;
+    uint32_t generation;
+    uint32_t count;
+    // Sums of the points within the voxel
+    float x;
+    float y;
+    float z;
+    float intensity;
+  };
+
+  VoxelGrid():
+    inverse_leaf_size(0.0f),
+    mask(0),
+    shift(64),
+    max_size(0),
+    generation(1),
+    dropped(0),
+    occupied_size(0) {}
+
+  // Allocate the table for at most max_voxels voxels per sweep.
+  // The table is kept at most half full.
+  void initialize(const double& leaf_size, const size_t& max_voxels) {
+    inverse_leaf_size = static_cast<float>(1.0 / leaf_size);
+    size_t capacity = 1;
+    shift = 64;
+    while (capacity < 2*max_voxels) {
+      capacity *= 2;
+      --shift;
+    }
+    mask = capacity - 1;
+    max_size = capacity / 2;
+    voxels.assign(capacity, Voxel());
+    occupied.assign(max_size, 0);
+    occupied_size = 0;
+    generation = 1;
+    dropped = 0;
+    return;
+  }
+
+  // Start a new sweep.
+  void reset() {
+    occupied_size = 0;
+    dropped = 0;
+    if (++generation == 0) {
+      // The counter wrapped around, so old tags could match again.
+      for (size_t i = 0; i < voxels.size(); ++i) voxels[i].generation = 0;
+      generation = 1;
+    }
+    return;
+  }
+
+  // Add a point to its voxel. Returns false if the point is dropped
+  // since the table is full.
+  bool add(const float& x, const float& y, const float& z,
+      const float& intensity) {
+    uint64_t key = voxelIndex(x) |
+      (voxelIndex(y) << KEY_BITS) | (voxelIndex(z) << 2*KEY_BITS);
+
+    for (size_t i = (key*HASH_MULTIPLIER) >> shift; ; i = (i+1) & mask) {
+      Voxel& voxel = voxels[i];
+      if (voxel.generation != generation) {
+        if (occupied_size == max_size) {
+          ++dropped;
+          return false;
+        }
+        voxel.key = key;
+        voxel.generation = generation;
+        voxel.count = 1;
+        voxel.x = x;
+        voxel.y = y;
+        voxel.z = z;
+        voxel.intensity = intensity;
+        occupied[occupied_size++] = i;
+        return true;
+      }
+      if (voxel.key == key) {
+        ++voxel.count;
+        voxel.x += x;
+        voxel.y += y;
+        voxel.z += z;
+        voxel.intensity += intensity;
+        return true;
+      }
+    }
+  }
+
+  // Voxels of the current sweep in the order they were created.
+  size_t size() const { return occupied_size; }
+  const Voxel& operator[](const size_t& i) const {
+    return voxels[occupied[i]];
+  }
+
+  // Points dropped in the current sweep.
+  size_t droppedCount() const { return dropped; }
+
+private:
+
+  // Each voxel index is kept in 21 bits, i.e. +-2^20 voxels.
+  static const int KEY_BITS = 21;
+  static const uint64_t HASH_MULTIPLIER = 0x9e3779b97f4a7c15ull;
+
+  uint64_t voxelIndex(const float& coordinate) const {
+    int64_t index = static_cast<int64_t>(
+        std::floor(coordinate*inverse_leaf_size));
+    return static_cast<uint64_t>(index + (1 << (KEY_BITS-1))) &
+      ((1ull << KEY_BITS) - 1);
+  }
+
+  float inverse_leaf_size;
+  size_t mask;
+  int shift;
+  size_t max_size;
+  uint32_t generation;
+  size_t dropped;
+
+  std::vector<Voxel> voxels;
+  std::vector<size_t> occupied;
+  size_t occupied_size;
+};
+
+} // end namespace velodyne_puck_decoder
+
+#endif
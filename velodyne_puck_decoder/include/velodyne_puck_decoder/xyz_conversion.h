@@ -0,0 +1,195 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DECODER_XYZ_CONVERSION_H
+#define VELODYNE_PUCK_DECODER_XYZ_CONVERSION_H
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+namespace velodyne_puck_decoder {
+
+// Number of raw azimuth values, which are in 0.01 degree units.
+static const int RAW_AZIMUTH_COUNT = 36000;
+static const double RAW_AZIMUTH_TO_RAD = M_PI / 18000.0;
+
+// Fractional bits of the fixed-point factors.
+static const int FIXED_POINT_SHIFT = 14;
+static const int32_t FIXED_POINT_ONE = 1 << FIXED_POINT_SHIFT;
+
+// Unit vector in the horizontal plane for a raw azimuth value.
+struct AzimuthVector {
+  float cos_azimuth;
+  float sin_azimuth;
+};
+
+// The same unit vector in Q14 fixed-point format.
+struct FixedAzimuthVector {
+  int16_t cos_azimuth;
+  int16_t sin_azimuth;
+};
+
+// Convert a factor within [-1, 1] to the fixed-point format.
+inline int32_t toFixedPoint(const double& value) {
+  return static_cast<int32_t>(floor(value*FIXED_POINT_ONE + 0.5));
+}
+
+// Unit vectors of all the raw azimuth values.
+template <typename Vector>
+struct AzimuthTable {
+  AzimuthTable();
+  Vector vectors[RAW_AZIMUTH_COUNT];
+};
+
+template <>
+inline AzimuthTable<AzimuthVector>::AzimuthTable() {
+  for (int i = 0; i < RAW_AZIMUTH_COUNT; ++i) {
+    double angle = i * RAW_AZIMUTH_TO_RAD;
+    vectors[i].cos_azimuth = static_cast<float>(cos(angle));
+    vectors[i].sin_azimuth = static_cast<float>(sin(angle));
+  }
+}
+
+template <>
+inline AzimuthTable<FixedAzimuthVector>::AzimuthTable() {
+  for (int i = 0; i < RAW_AZIMUTH_COUNT; ++i) {
+    double angle = i * RAW_AZIMUTH_TO_RAD;
+    vectors[i].cos_azimuth = static_cast<int16_t>(toFixedPoint(cos(angle)));
+    vectors[i].sin_azimuth = static_cast<int16_t>(toFixedPoint(sin(angle)));
+  }
+}
+
+// The tables are built once on first use, and shared
+// by all the decoders in the process.
+inline const AzimuthVector* azimuthTable() {
+  static const AzimuthTable<AzimuthVector> table;
+  return table.vectors;
+}
+
+inline const FixedAzimuthVector* fixedAzimuthTable() {
+  static const AzimuthTable<FixedAzimuthVector> table;
+  return table.vectors;
+}
+
+/*
+ * Per-laser factors of the conversion to xyz coordinates, with the
+ * calibration folded in. The raw distance is projected onto the
+ * horizontal plane and the vertical axis by the factors, and shifted
+ * by the offsets. The lateral offset is perpendicular to the beam
+ * within the horizontal plane.
+ */
+template <typename Scalar>
+struct LaserFactors {
+  LaserFactors():
+    horizontal_factor(0),
+    vertical_factor(0),
+    horizontal_offset(0),
+    vertical_offset(0),
+    lateral_offset(0) {}
+
+  Scalar horizontal_factor;
+  Scalar vertical_factor;
+  Scalar horizontal_offset;
+  Scalar vertical_offset;
+  Scalar lateral_offset;
+};
+
+/*
+ * Convert the shots of a packet to xyz coordinates. The shots are
+ * indexed by fir_idx*lasers+laser_idx, with the distances in raw units
+ * and the azimuths in 0.01 degree units measured clockwise from the y
+ * axis of the sensor. The factors and offsets are in meters.
+ */
+inline void convertToXyz(
+    const uint16_t* distance, const uint16_t* azimuth,
+    const LaserFactors<float>* laser_factors,
+    const AzimuthVector* azimuth_table,
+    const size_t& firings, const size_t& lasers,
+    float* x, float* y, float* z) {
+  for (size_t fir_idx = 0; fir_idx < firings; ++fir_idx) {
+    for (size_t laser_idx = 0; laser_idx < lasers; ++laser_idx) {
+      size_t shot_idx = fir_idx*lasers + laser_idx;
+      float shot_distance = distance[shot_idx];
+
+      const LaserFactors<float>& laser = laser_factors[laser_idx];
+      const AzimuthVector& direction = azimuth_table[azimuth[shot_idx]];
+      float horizontal_distance = shot_distance*laser.horizontal_factor +
+        laser.horizontal_offset;
+
+      x[shot_idx] = horizontal_distance*direction.cos_azimuth +
+        laser.lateral_offset*direction.sin_azimuth;
+      y[shot_idx] = laser.lateral_offset*direction.cos_azimuth -
+        horizontal_distance*direction.sin_azimuth;
+      z[shot_idx] = shot_distance*laser.vertical_factor +
+        laser.vertical_offset;
+    }
+  }
+  return;
+}
+
+/*
+ * Integer version of convertToXyz for targets with slow floating
+ * point. The factors are Q14 without the distance resolution, the
+ * horizontal and vertical offsets are Q14 raw units, and the lateral
+ * offset is in raw units. The coordinates are computed in raw units
+ * with 32-bit integers, and only the final scaling to meters is done
+ * in floating point. Each Q14 factor is within 2^-15 of its value and
+ * each shift rounds to the nearest unit, so for a raw distance d, z is
+ * within d/2^15 + 0.5 raw units of the floating point conversion. x and
+ * y go through two factors and the lateral offset rounded to a unit,
+ * and are within d/2^14 + 1.5 raw units, i.e. up to 11mm at 130m.
+ */
+inline void convertToXyzFixed(
+    const uint16_t* distance, const uint16_t* azimuth,
+    const LaserFactors<int32_t>* laser_factors,
+    const FixedAzimuthVector* azimuth_table, const float& resolution,
+    const size_t& firings, const size_t& lasers,
+    float* x, float* y, float* z) {
+  static const int32_t half = 1 << (FIXED_POINT_SHIFT-1);
+
+  for (size_t fir_idx = 0; fir_idx < firings; ++fir_idx) {
+    for (size_t laser_idx = 0; laser_idx < lasers; ++laser_idx) {
+      size_t shot_idx = fir_idx*lasers + laser_idx;
+      int32_t shot_distance = distance[shot_idx];
+
+      const LaserFactors<int32_t>& laser = laser_factors[laser_idx];
+      const FixedAzimuthVector& direction = azimuth_table[azimuth[shot_idx]];
+      int32_t horizontal_distance = (shot_distance*laser.horizontal_factor +
+          laser.horizontal_offset + half) >> FIXED_POINT_SHIFT;
+
+      int32_t x_units = (horizontal_distance*direction.cos_azimuth +
+          laser.lateral_offset*direction.sin_azimuth + half) >>
+        FIXED_POINT_SHIFT;
+      int32_t y_units = (laser.lateral_offset*direction.cos_azimuth -
+          horizontal_distance*direction.sin_azimuth + half) >>
+        FIXED_POINT_SHIFT;
+      int32_t z_units = (shot_distance*laser.vertical_factor +
+          laser.vertical_offset + half) >> FIXED_POINT_SHIFT;
+
+      x[shot_idx] = x_units * resolution;
+      y[shot_idx] = y_units * resolution;
+      z[shot_idx] = z_units * resolution;
+    }
+  }
+  return;
+}
+
+} // end namespace velodyne_puck_decoder
+
+#endif
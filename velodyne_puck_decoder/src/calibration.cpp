@@ -0,0 +1,83 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <exception>
+#include <ros/ros.h>
+#include <yaml-cpp/yaml.h>
+#include <velodyne_puck_decoder/calibration.h>
+
+namespace velodyne_puck_decoder {
+
+void Calibration::setNominal(
+    const double* altitudes, const size_t& num_lasers) {
+  model.clear();
+  lasers.assign(num_lasers, LaserCorrection());
+  for (size_t i = 0; i < num_lasers; ++i)
+    lasers[i].vert_correction = altitudes[i];
+  return;
+}
+
+bool Calibration::read(const std::string& path) {
+  std::string new_model;
+  std::vector<LaserCorrection> new_lasers;
+
+  try {
+    YAML::Node config = YAML::LoadFile(path);
+    if (config["model"]) new_model = config["model"].as<std::string>();
+
+    const YAML::Node& laser_configs = config["lasers"];
+    if (!laser_configs.IsSequence()) {
+      ROS_ERROR("Calibration %s has no list of lasers", path.c_str());
+      return false;
+    }
+    new_lasers.resize(config["num_lasers"] ?
+        config["num_lasers"].as<size_t>() : laser_configs.size());
+
+    for (size_t i = 0; i < laser_configs.size(); ++i) {
+      const YAML::Node& laser_config = laser_configs[i];
+      int laser_id = laser_config["laser_id"].as<int>();
+      if (laser_id < 0 || laser_id >= static_cast<int>(new_lasers.size())) {
+        ROS_ERROR("Calibration %s has laser_id %d, but %lu lasers",
+            path.c_str(), laser_id, new_lasers.size());
+        return false;
+      }
+
+      // Missing corrections default to zero.
+      LaserCorrection& laser = new_lasers[laser_id];
+      laser.vert_correction =
+        laser_config["vert_correction"].as<double>();
+      laser.rot_correction =
+        laser_config["rot_correction"].as<double>(0.0);
+      laser.dist_correction =
+        laser_config["dist_correction"].as<double>(0.0);
+      laser.vert_offset_correction =
+        laser_config["vert_offset_correction"].as<double>(0.0);
+      laser.horiz_offset_correction =
+        laser_config["horiz_offset_correction"].as<double>(0.0);
+    }
+  } catch (const std::exception& e) {
+    ROS_ERROR("Cannot read calibration %s: %s", path.c_str(), e.what());
+    return false;
+  }
+
+  model = new_model;
+  lasers = new_lasers;
+  return true;
+}
+
+} // end namespace velodyne_puck_decoder
@@ -0,0 +1,206 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <zstd.h>
+#include <ros/ros.h>
+#include <velodyne_puck_decoder/range_image_codec.h>
+
+namespace velodyne_puck_decoder {
+
+const char* const RangeImageCodec::FORMAT = "delta-zstd";
+
+namespace {
+
+// Size of the delta coded image before the entropy coding.
+size_t encodedSize(const size_t& height, const size_t& width) {
+  return width*sizeof(uint16_t) + height*width*sizeof(uint16_t) +
+    height*width*sizeof(uint8_t) + width*sizeof(float);
+}
+
+// Delta code 16-bit values, with the low and high bytes
+// of the deltas written to separate planes.
+void encodeDeltas(const uint16_t* values, const size_t& count,
+    uint8_t* low, uint8_t* high) {
+  uint16_t previous = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint16_t delta = values[i] - previous;
+    previous = values[i];
+    low[i] = delta & 0xff;
+    high[i] = delta >> 8;
+  }
+  return;
+}
+
+void decodeDeltas(const uint8_t* low, const uint8_t* high,
+    const size_t& count, uint16_t* values) {
+  uint16_t previous = 0;
+  for (size_t i = 0; i < count; ++i) {
+    previous += static_cast<uint16_t>(low[i] | (high[i] << 8));
+    values[i] = previous;
+  }
+  return;
+}
+
+void encodeDeltas(const uint8_t* values, const size_t& count,
+    uint8_t* deltas) {
+  uint8_t previous = 0;
+  for (size_t i = 0; i < count; ++i) {
+    deltas[i] = values[i] - previous;
+    previous = values[i];
+  }
+  return;
+}
+
+void decodeDeltas(const uint8_t* deltas, const size_t& count,
+    uint8_t* values) {
+  uint8_t previous = 0;
+  for (size_t i = 0; i < count; ++i) {
+    previous += deltas[i];
+    values[i] = previous;
+  }
+  return;
+}
+
+} // end anonymous namespace
+
+RangeImageCodec::RangeImageCodec():
+  level(1),
+  cctx(ZSTD_createCCtx()),
+  dctx(ZSTD_createDCtx()) {
+  return;
+}
+
+RangeImageCodec::~RangeImageCodec() {
+  ZSTD_freeCCtx(cctx);
+  ZSTD_freeDCtx(dctx);
+  return;
+}
+
+bool RangeImageCodec::encode(
+    const velodyne_puck_msgs::VelodynePuckRangeImage& image,
+    velodyne_puck_msgs::VelodynePuckCompressedRangeImage& compressed) {
+  const size_t height = image.height;
+  const size_t width = image.width;
+  if (image.range.size() != height*width ||
+      image.intensity.size() != height*width ||
+      image.azimuth.size() != width || image.time.size() != width) {
+    ROS_ERROR("Range image of %lux%lu has inconsistent sizes.",
+        height, width);
+    return false;
+  }
+
+  // Delta code the columns along the azimuth, and the
+  // readings along each row.
+  buffer.resize(encodedSize(height, width));
+  uint8_t* data = buffer.empty() ? NULL : &buffer[0];
+  if (width > 0) {
+    encodeDeltas(&image.azimuth[0], width, data, data+width);
+    data += width*sizeof(uint16_t);
+    for (size_t row = 0; row < height; ++row)
+      encodeDeltas(&image.range[row*width], width,
+          data + row*width, data + (height+row)*width);
+    data += height*width*sizeof(uint16_t);
+    for (size_t row = 0; row < height; ++row)
+      encodeDeltas(&image.intensity[row*width], width, data + row*width);
+    data += height*width*sizeof(uint8_t);
+    std::memcpy(data, &image.time[0], width*sizeof(float));
+  }
+
+  compressed.data.resize(ZSTD_compressBound(buffer.size()));
+  size_t compressed_size = ZSTD_compressCCtx(cctx,
+      compressed.data.empty() ? NULL : &compressed.data[0],
+      compressed.data.size(), buffer.empty() ? NULL : &buffer[0],
+      buffer.size(), level);
+  if (ZSTD_isError(compressed_size)) {
+    ROS_ERROR("Cannot compress the range image: %s",
+        ZSTD_getErrorName(compressed_size));
+    return false;
+  }
+  compressed.data.resize(compressed_size);
+
+  compressed.header = image.header;
+  compressed.height = image.height;
+  compressed.width = image.width;
+  compressed.distance_resolution = image.distance_resolution;
+  compressed.altitude = image.altitude;
+  compressed.row_time_offset = image.row_time_offset;
+  compressed.rot_correction = image.rot_correction;
+  compressed.dist_correction = image.dist_correction;
+  compressed.vert_offset_correction = image.vert_offset_correction;
+  compressed.horiz_offset_correction = image.horiz_offset_correction;
+  compressed.format = FORMAT;
+  compressed.uncompressed_size = buffer.size();
+  return true;
+}
+
+bool RangeImageCodec::decode(
+    const velodyne_puck_msgs::VelodynePuckCompressedRangeImage& compressed,
+    velodyne_puck_msgs::VelodynePuckRangeImage& image) {
+  const size_t height = compressed.height;
+  const size_t width = compressed.width;
+  if (compressed.format != FORMAT ||
+      compressed.uncompressed_size != encodedSize(height, width)) {
+    ROS_ERROR("Unknown range image encoding '%s' of %u bytes for %lux%lu.",
+        compressed.format.c_str(), compressed.uncompressed_size,
+        height, width);
+    return false;
+  }
+
+  buffer.resize(compressed.uncompressed_size);
+  size_t size = ZSTD_decompressDCtx(dctx,
+      buffer.empty() ? NULL : &buffer[0], buffer.size(),
+      compressed.data.empty() ? NULL : &compressed.data[0],
+      compressed.data.size());
+  if (ZSTD_isError(size) || size != buffer.size()) {
+    ROS_ERROR("Cannot decompress the range image: %s",
+        ZSTD_isError(size) ? ZSTD_getErrorName(size) : "truncated data");
+    return false;
+  }
+
+  image.header = compressed.header;
+  image.height = compressed.height;
+  image.width = compressed.width;
+  image.distance_resolution = compressed.distance_resolution;
+  image.altitude = compressed.altitude;
+  image.row_time_offset = compressed.row_time_offset;
+  image.rot_correction = compressed.rot_correction;
+  image.dist_correction = compressed.dist_correction;
+  image.vert_offset_correction = compressed.vert_offset_correction;
+  image.horiz_offset_correction = compressed.horiz_offset_correction;
+  image.azimuth.resize(width);
+  image.range.resize(height*width);
+  image.intensity.resize(height*width);
+  image.time.resize(width);
+  if (width == 0) return true;
+
+  const uint8_t* data = &buffer[0];
+  decodeDeltas(data, data+width, width, &image.azimuth[0]);
+  data += width*sizeof(uint16_t);
+  for (size_t row = 0; row < height; ++row)
+    decodeDeltas(data + row*width, data + (height+row)*width,
+        width, &image.range[row*width]);
+  data += height*width*sizeof(uint16_t);
+  for (size_t row = 0; row < height; ++row)
+    decodeDeltas(data + row*width, width, &image.intensity[row*width]);
+  data += height*width*sizeof(uint8_t);
+  std::memcpy(&image.time[0], data, width*sizeof(float));
+  return true;
+}
+
+} // end namespace velodyne_puck_decoder
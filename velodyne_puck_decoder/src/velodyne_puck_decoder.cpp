@@ -15,21 +15,133 @@
  * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <boost/bind.hpp>
 #include <velodyne_puck_decoder/velodyne_puck_decoder.h>
+#include <velodyne_puck_decoder/tracepoints.h>
 
 using namespace std;
 
 namespace velodyne_puck_decoder {
+
+// Names of the stages in the latency report, in the
+// order of VelodynePuckDecoder::LatencyStage.
+static const char* LATENCY_STAGE_NAMES[] = {
+  "receive_to_callback",
+  "decode",
+  "assembly",
+  "sweep_publish",
+  "end_to_end"
+};
+
 VelodynePuckDecoder::VelodynePuckDecoder(
     ros::NodeHandle& n, ros::NodeHandle& pn):
   nh(n),
   pnh(pn),
   publish_point_cloud(true),
+  organized_point_cloud(false),
+  publish_range_image(false),
+  sector_angle(0.0),
+  voxel_leaf_size(0.0),
+  segment_ground(false),
+  sensor_height(1.0),
+  ground_max_slope(10.0),
+  ground_slope_tan(0.0f),
+  ground_time(0.0),
+  ground_points(0),
+  last_ground_time(0.0),
+  last_ground_points(0),
+  last_obstacle_points(0),
+  cut_angle(0.0),
+  phase_lock(false),
+  cut_azimuth(0),
+  rotation_period_ns(0),
+  latency_sum(0.0),
+  latency_max(0.0),
+  latency_count(0),
+  phase_error_max(0),
+  unlocked_sweeps(0),
+  latency_report_period(1.0),
+  trace_latency(true),
+  sweep_publish_ns(0),
+  sweep_published(false),
+  received_packets(0),
+  published_sweeps(0),
+  sweep_enabled(false),
+  point_cloud_enabled(false),
+  range_image_enabled(false),
+  compressed_range_image_enabled(false),
+  sector_enabled(false),
+  voxel_cloud_enabled(false),
+  ground_enabled(false),
+  xyz_enabled(false),
+  convert_xyz(true),
+  sweep_timeout(0.0),
+  sweep_timeout_ns(0),
+  max_sweep_firings(0),
+  last_arrival_ns(0),
+  sweep_flushed(false),
+  azimuth_per_firing(0.0f),
+  sweep_firings(0),
+  missing_firings(0),
+  incomplete_sweeps(0),
+  timed_out_sweeps(0),
+  flushed_sweeps(0),
+  min_completeness(1.0f),
+  deskew(false),
+  deskew_reference_valid(false),
+  latest_deskew_poses(0),
+  skipped_deskew_packets(0),
   is_first_sweep(true),
-  last_azimuth(0.0),
-  sweep_start_time(0.0),
-  packet_start_time(0.0),
-  sweep_data(new velodyne_puck_msgs::VelodynePuckSweep()){
+  sensor_configured(false),
+  lasers(0),
+  returns_per_firing(1),
+  firings_per_packet(0),
+  azimuth_table(NULL),
+  last_azimuth(0),
+  sweep_start_ns(0),
+  packet_start_offset(0),
+  reported_exhausted_counts(OUTPUT_POOLS, 0),
+  cloud_columns(0),
+  range_image_width(0),
+  range_image_capacity(0),
+  compression_level(1),
+  compression_running(false),
+  compressed_images(0),
+  dropped_images(0),
+  uncompressed_bytes(0),
+  compressed_bytes(0),
+  encode_time(0.0),
+  max_encode_time(0.0),
+  sectors_per_sweep(0),
+  sectors_per_raw_azimuth(0.0f),
+  sector_capacity(0),
+  sector_start_offset(0),
+  pipeline_running(false),
+  next_packet_seq(0),
+  next_assembled_seq(0),
+  max_points_per_scan(0),
+  sweep_allocations(0){
+  return;
+}
+
+VelodynePuckDecoder::~VelodynePuckDecoder() {
+  {
+    boost::lock_guard<boost::mutex> lock(pipeline_mutex);
+    pipeline_running = false;
+  }
+  packet_queued.notify_all();
+  packet_decoded.notify_all();
+  slot_freed.notify_all();
+  pipeline_threads.join_all();
+
+  {
+    boost::lock_guard<boost::mutex> lock(compression_mutex);
+    compression_running = false;
+  }
+  range_image_queued.notify_all();
+  if (compression_thread.joinable()) compression_thread.join();
   return;
 }
 
@@ -38,9 +150,54 @@ bool VelodynePuckDecoder::loadParameters() {
   pnh.param<double>("max_range", max_range, 100.0);
   pnh.param<double>("frequency", frequency, 20.0);
   pnh.param<bool>("publish_point_cloud", publish_point_cloud, true);
+  pnh.param<bool>("organized_point_cloud", organized_point_cloud, false);
+  pnh.param<bool>("publish_range_image", publish_range_image, false);
+  pnh.param<int>("compression_level", compression_level, 1);
+  range_image_codec.setLevel(compression_level);
+  pnh.param<double>("sector_angle", sector_angle, 0.0);
+  pnh.param<double>("voxel_leaf_size", voxel_leaf_size, 0.0);
+  pnh.param<bool>("segment_ground", segment_ground, false);
+  pnh.param<double>("sensor_height", sensor_height, 1.0);
+  pnh.param<double>("ground_max_slope", ground_max_slope, 10.0);
+  ground_slope_tan = static_cast<float>(tan(ground_max_slope*DEG_TO_RAD));
+  pnh.param<int>("decode_threads", decode_threads, 0);
+  pnh.param<int>("sweep_pool_size", sweep_pool_size, 4);
+  pnh.param<string>("calibration", calibration_file, "");
+  pnh.param<double>("cut_angle", cut_angle, 0.0);
+  pnh.param<bool>("phase_lock", phase_lock, false);
+
+  // The cut is done on the raw azimuth of the firings.
+  double cut_degrees = fmod(cut_angle, 360.0);
+  if (cut_degrees < 0.0) cut_degrees += 360.0;
+  cut_azimuth = static_cast<uint16_t>(
+      static_cast<int>(floor(cut_degrees*100.0 + 0.5)) % RAW_AZIMUTH_COUNT);
+  rotation_period_ns = static_cast<uint64_t>(floor(1e9/frequency + 0.5));
+
+  // By default, a sweep may take up to 1.5 rotation periods.
+  pnh.param<double>("sweep_timeout", sweep_timeout, 0.0);
+  if (sweep_timeout <= 0.0) sweep_timeout = 1.5 / frequency;
+  sweep_timeout_ns = static_cast<uint64_t>(floor(sweep_timeout*1e9 + 0.5));
+  max_sweep_firings = static_cast<size_t>(
+      ceil(sweep_timeout*1e6 / FIRING_TOFFSET));
+
+  // The range check is done on the raw distance readings.
+  min_range_units = static_cast<uint16_t>(std::min(DISTANCE_MAX_UNITS,
+        std::max(0.0, ceil(min_range / DISTANCE_RESOLUTION))));
+  max_range_units = static_cast<uint16_t>(std::min(DISTANCE_MAX_UNITS,
+        std::max(0.0, floor(max_range / DISTANCE_RESOLUTION))));
 
   pnh.param<string>("fixed_frame_id", fixed_frame_id, "map");
   pnh.param<string>("child_frame_id", child_frame_id, "velodyne");
+  pnh.param<bool>("deskew", deskew, false);
+  pnh.param<double>("latency_report_period", latency_report_period, 1.0);
+  trace_latency = latency_report_period > 0.0;
+
+  // Without a calibration file, the nominal geometry of
+  // the sensor is used once the model is known.
+  if (!calibration_file.empty()) {
+    if (!calibration.read(calibration_file)) return false;
+    ROS_INFO("Calibration loaded from %s", calibration_file.c_str());
+  }
   return true;
 }
 
@@ -51,6 +208,48 @@ bool VelodynePuckDecoder::createRosIO() {
       "velodyne_sweep", 10);
   point_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(
       "velodyne_point_cloud", 10);
+  range_image_pub = nh.advertise<velodyne_puck_msgs::VelodynePuckRangeImage>(
+      "velodyne_range_image", 10);
+  compressed_range_image_pub = nh.advertise<
+    velodyne_puck_msgs::VelodynePuckCompressedRangeImage>(
+      "velodyne_compressed_range_image", 10);
+  sector_pub = nh.advertise<velodyne_puck_msgs::VelodynePuckSector>(
+      "velodyne_sector", 10);
+  voxel_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(
+      "velodyne_voxel_cloud", 10);
+  ground_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(
+      "velodyne_ground_cloud", 10);
+  obstacle_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(
+      "velodyne_obstacle_cloud", 10);
+  latency_pub = nh.advertise<velodyne_puck_msgs::VelodynePuckLatencyReport>(
+      "velodyne_latency", 10);
+  if (deskew) tf_listener.reset(new tf::TransformListener());
+  flush_timer = nh.createTimer(ros::Duration(0.5*sweep_timeout),
+      &VelodynePuckDecoder::flushCallback, this);
+  if (trace_latency)
+    latency_timer = nh.createTimer(ros::Duration(latency_report_period),
+        &VelodynePuckDecoder::latencyCallback, this);
+
+  // ROS diagnostics
+  diagnostics.setHardwareID("Velodyne_VLP16");
+  diagnostics.add("Sweep pool", this,
+      &VelodynePuckDecoder::sweepPoolDiagnostics);
+  if (segment_ground)
+    diagnostics.add("Ground segmentation", this,
+        &VelodynePuckDecoder::groundDiagnostics);
+  if (deskew)
+    diagnostics.add("Deskew", this,
+        &VelodynePuckDecoder::deskewDiagnostics);
+  if (publish_range_image)
+    diagnostics.add("Range image compression", this,
+        &VelodynePuckDecoder::compressionDiagnostics);
+  diagnostics.add("Sweep timing", this,
+      &VelodynePuckDecoder::timingDiagnostics);
+  diagnostics.add("Sweep assembly", this,
+      &VelodynePuckDecoder::assemblyDiagnostics);
+  if (trace_latency)
+    diagnostics.add("Latency", this,
+        &VelodynePuckDecoder::latencyDiagnostics);
   return true;
 }
 
@@ -65,93 +264,328 @@ bool VelodynePuckDecoder::initialize() {
     return false;
   }
 
-  // Fill in the altitude for each scan.
-  for (size_t scan_idx = 0; scan_idx < 16; ++scan_idx) {
-    size_t remapped_scan_idx = scan_idx%2 == 0 ? scan_idx/2 : scan_idx/2+8;
-    sweep_data->scans[remapped_scan_idx].altitude = scan_altitude[scan_idx];
+  // The maximum number of firings within a revolution at the
+  // configured frequency, with some margin for the motor speed.
+  max_points_per_scan = static_cast<size_t>(
+      ceil(1.1e6 / (frequency*FIRING_TOFFSET)));
+  sweep_pool.setCapacity(std::max(sweep_pool_size, 1));
+  cloud_pool.setCapacity(std::max(sweep_pool_size, 1));
+  range_image_pool.setCapacity(std::max(sweep_pool_size, 1));
+  compressed_range_image_pool.setCapacity(std::max(sweep_pool_size, 1));
+  sector_pool.setCapacity(std::max(sweep_pool_size, 1));
+  voxel_cloud_pool.setCapacity(std::max(sweep_pool_size, 1));
+  ground_cloud_pool.setCapacity(2*std::max(sweep_pool_size, 1));
+
+  // The organized point cloud has one column per firing, i.e. the
+  // native horizontal resolution of the sensor at this frequency.
+  cloud_columns = static_cast<size_t>(
+      std::max(1.0, floor(1e6/(frequency*FIRING_TOFFSET)+0.5)));
+
+  // The sectors are counted from the cut of the sweeps, so that no
+  // sector is split across two sweeps. The last sector is smaller if
+  // sector_angle does not divide 360 degrees.
+  if (sector_angle > 0.0) {
+    sector_angle = std::min(sector_angle, 360.0);
+    sectors_per_sweep = static_cast<size_t>(ceil(360.0/sector_angle-1e-6));
+    sectors_per_raw_azimuth = static_cast<float>(1.0 / (sector_angle*100.0));
+    sector_capacity = static_cast<size_t>(
+        ceil(max_points_per_scan*sector_angle/360.0)) + 1;
+  }
+
+  // Start the decode pipeline, with a few packets in flight
+  // per worker thread.
+  if (decode_threads > 0) {
+    pipeline_slots.resize(PIPELINE_SLOTS_PER_THREAD * decode_threads);
+    pipeline_running = true;
+    for (int i = 0; i < decode_threads; ++i)
+      pipeline_threads.create_thread(
+          boost::bind(&VelodynePuckDecoder::decodeLoop, this));
+    pipeline_threads.create_thread(
+        boost::bind(&VelodynePuckDecoder::assembleLoop, this));
   }
 
-  // Create the sin and cos table for different azimuth values.
-  for (size_t i = 0; i < 6300; ++i) {
-    double angle = static_cast<double>(i) / 1000.0;
-    cos_azimuth_table[i] = cos(angle);
-    sin_azimuth_table[i] = sin(angle);
+  if (publish_range_image) {
+    compression_running = true;
+    compression_thread = boost::thread(
+        boost::bind(&VelodynePuckDecoder::compressLoop, this));
   }
 
   return true;
 }
 
+bool VelodynePuckDecoder::configureSensor(
+    const velodyne_puck_msgs::VelodynePuckPacket& msg) {
+  const RawPacket* raw_packet = (const RawPacket*) (&(msg.data[0]));
+  if (!getSensorInfo(raw_packet->factory[1], sensor)) {
+    ROS_WARN_THROTTLE(1.0, "Skip packet of unsupported sensor model 0x%x",
+        raw_packet->factory[1]);
+    return false;
+  }
+  returns_per_firing = raw_packet->factory[0] == DUAL_RETURN ? 2 : 1;
+  ROS_INFO("Decoding packets of a Velodyne %s in %s return mode",
+      sensor.name, returns_per_firing == 2 ? "dual" : "single");
+  lasers = sensor.lasers;
+  firings_per_packet = SCANS_PER_PACKET / lasers;
+
+  // Both returns of each firing are kept in the sweep.
+  max_points_per_scan *= returns_per_firing;
+  max_sweep_firings *= returns_per_firing;
+  sector_capacity *= returns_per_firing;
+
+  // The lasers of the Puck Hi-Res and of the VLP-16 do not tell
+  // the two apart, so the model of the calibration is checked too.
+  if (!calibration.model.empty() && calibration.model != sensor.name) {
+    ROS_ERROR("Calibration %s is for a %s, but the packets are from a %s. "
+        "Using the nominal geometry instead.", calibration_file.c_str(),
+        calibration.model.c_str(), sensor.name);
+    calibration.setNominal(sensor.altitude, lasers);
+  } else if (calibration.lasers.size() != lasers) {
+    if (!calibration_file.empty())
+      ROS_ERROR("Calibration %s has %lu lasers, but the %s has %lu. "
+          "Using the nominal geometry instead.", calibration_file.c_str(),
+          calibration.lasers.size(), sensor.name, lasers);
+    calibration.setNominal(sensor.altitude, lasers);
+  } else if (calibration.model.empty()) {
+    ROS_WARN("Calibration %s does not name its sensor model, "
+        "so it cannot be checked against the %s.",
+        calibration_file.c_str(), sensor.name);
+  }
+
+  // The rings are counted from the bottom.
+  laser_rings.resize(lasers);
+  ring_lasers.resize(lasers);
+  for (size_t i = 0; i < lasers; ++i) {
+    laser_rings[i] = 0;
+    for (size_t j = 0; j < lasers; ++j) {
+      const double& altitude = calibration.lasers[j].vert_correction;
+      const double& ref_altitude = calibration.lasers[i].vert_correction;
+      if (altitude < ref_altitude || (altitude == ref_altitude && j < i))
+        ++laser_rings[i];
+    }
+  }
+  for (size_t i = 0; i < lasers; ++i) ring_lasers[laser_rings[i]] = i;
+  scan_sizes.resize(lasers);
+
+  // A sweep has at most as many voxels as points.
+  if (voxel_leaf_size > 0.0)
+    voxel_grid.initialize(voxel_leaf_size, lasers*max_points_per_scan);
+
+  diagnostics.setHardwareID(string("Velodyne ") + sensor.name);
+  computeLaserFactors();
+  resetSweep();
+  sensor_configured = true;
+  return true;
+}
+
+void VelodynePuckDecoder::computeLaserFactors() {
+#ifdef VELODYNE_PUCK_FIXED_POINT
+  azimuth_table = fixedAzimuthTable();
+#else
+  azimuth_table = azimuthTable();
+#endif
+
+  for (size_t scan_idx = 0; scan_idx < lasers; ++scan_idx) {
+    const LaserCorrection& laser = calibration.lasers[scan_idx];
+    double cos_altitude = cos(laser.vert_correction);
+    double sin_altitude = sin(laser.vert_correction);
+
+    // Offsets of the beam from the distance correction,
+    // and the position of the laser within the sensor [m].
+    double horizontal_offset = laser.dist_correction*cos_altitude -
+      laser.vert_offset_correction*sin_altitude;
+    double vertical_offset = laser.dist_correction*sin_altitude +
+      laser.vert_offset_correction*cos_altitude;
+
+#ifdef VELODYNE_PUCK_FIXED_POINT
+    LaserFactors<int32_t>& factors = laser_factors[scan_idx];
+    factors.horizontal_factor = toFixedPoint(cos_altitude);
+    factors.vertical_factor = toFixedPoint(sin_altitude);
+    factors.horizontal_offset =
+      toFixedPoint(horizontal_offset/DISTANCE_RESOLUTION);
+    factors.vertical_offset =
+      toFixedPoint(vertical_offset/DISTANCE_RESOLUTION);
+    factors.lateral_offset = static_cast<int32_t>(floor(
+          laser.horiz_offset_correction/DISTANCE_RESOLUTION + 0.5));
+#else
+    LaserFactors<float>& factors = laser_factors[scan_idx];
+    factors.horizontal_factor = DISTANCE_RESOLUTION * cos_altitude;
+    factors.vertical_factor = DISTANCE_RESOLUTION * sin_altitude;
+    factors.horizontal_offset = horizontal_offset;
+    factors.vertical_offset = vertical_offset;
+    factors.lateral_offset = laser.horiz_offset_correction;
+#endif
+
+    // The rotation correction is applied to the azimuth of
+    // each shot while the packet is decoded.
+    shot_azimuth_fraction[scan_idx] = toFixedPoint(
+        sensor.time_offset[scan_idx] / FIRING_TOFFSET);
+    int azimuth_offset = static_cast<int>(
+        floor(-laser.rot_correction/RAW_AZIMUTH_TO_RAD + 0.5));
+    azimuth_offset %= RAW_AZIMUTH_COUNT;
+    laser_azimuth_offset[scan_idx] = azimuth_offset < 0 ?
+      azimuth_offset + RAW_AZIMUTH_COUNT : azimuth_offset;
+
+    laser_time_offset[scan_idx] = static_cast<uint32_t>(
+        floor(sensor.time_offset[scan_idx]*1e3 + 0.5));
+  }
+
+  // The returns of a firing share its time.
+  for (size_t fir_idx = 0; fir_idx <= MAX_FIRINGS_PER_PACKET; ++fir_idx)
+    firing_time_offset[fir_idx] = static_cast<uint32_t>(floor(
+          fir_idx/returns_per_firing*FIRING_TOFFSET*1e3 + 0.5));
+  return;
+}
+
 bool VelodynePuckDecoder::checkPacketValidity(const RawPacket* packet) {
   for (size_t blk_idx = 0; blk_idx < BLOCKS_PER_PACKET; ++blk_idx) {
     if (packet->blocks[blk_idx].header != UPPER_BANK) {
-      ROS_WARN("Skip invalid VLP-16 packet: block %lu header is %x",
-          blk_idx, packet->blocks[blk_idx].header);
+      ROS_WARN("Skip invalid %s packet: block %lu header is %x",
+          sensor.name, blk_idx, packet->blocks[blk_idx].header);
       return false;
     }
   }
+  if (packet->factory[1] != sensor.model) {
+    ROS_WARN_THROTTLE(1.0, "Skip packet of sensor model 0x%x, "
+        "the decoder is set up for the %s", packet->factory[1], sensor.name);
+    return false;
+  }
+  if ((packet->factory[0] == DUAL_RETURN) != (returns_per_firing == 2)) {
+    ROS_WARN_THROTTLE(1.0, "Skip packet of return mode 0x%x, the decoder "
+        "is set up for %s return", packet->factory[0],
+        returns_per_firing == 2 ? "dual" : "single");
+    return false;
+  }
   return true;
 }
 
 void VelodynePuckDecoder::publishPointCloud() {
-  pcl::PointCloud<pcl::PointXYZI>::Ptr point_cloud(
-      new pcl::PointCloud<pcl::PointXYZI>());
-  point_cloud->header.stamp =
-    pcl_conversions::toPCL(sweep_data->header).stamp;
+  cloud_writer.finish(1);
+  point_cloud->header.stamp.fromNSec(sweep_start_ns);
   point_cloud->header.frame_id = child_frame_id;
-  point_cloud->height = 1;
-
-  for (size_t i = 0; i < 16; ++i) {
-    const velodyne_puck_msgs::VelodynePuckScan& scan = sweep_data->scans[i];
-    // The first and last point in each scan is ignored, which
-    // seems to be corrupted based on the received data.
-    // TODO: The two end points should be removed directly
-    //    in the scans.
-    if (scan.points.size() == 0) continue;
-    for (size_t j = 1; j < scan.points.size()-1; ++j) {
-      pcl::PointXYZI point;
-      point.x = scan.points[j].x;
-      point.y = scan.points[j].y;
-      point.z = scan.points[j].z;
-      point.intensity = scan.points[j].intensity;
-      point_cloud->points.push_back(point);
-      ++point_cloud->width;
-    }
+  point_cloud_pub.publish(point_cloud);
+  return;
+}
+
+void VelodynePuckDecoder::publishRangeImage() {
+  // Pack the rows, which are filled with a stride of the capacity.
+  size_t height = range_image->height;
+  for (size_t row = 1; row < height; ++row) {
+    std::memmove(&range_image->range[row*range_image_width],
+        &range_image->range[row*range_image_capacity],
+        range_image_width*sizeof(uint16_t));
+    std::memmove(&range_image->intensity[row*range_image_width],
+        &range_image->intensity[row*range_image_capacity],
+        range_image_width*sizeof(uint8_t));
   }
+  range_image->range.resize(height*range_image_width);
+  range_image->intensity.resize(height*range_image_width);
+  range_image->azimuth.resize(range_image_width);
+  range_image->time.resize(range_image_width);
 
-  point_cloud_pub.publish(point_cloud);
-  //sweep_pub.publish(sweep_data);
+  range_image->header.stamp.fromNSec(sweep_start_ns);
+  range_image->header.frame_id = child_frame_id;
+  range_image->width = range_image_width;
+  range_image_pub.publish(range_image);
+
+  // Hand the image over to the compression thread, replacing
+  // an image which is still waiting.
+  if (compressed_range_image_enabled) {
+    boost::lock_guard<boost::mutex> lock(compression_mutex);
+    if (pending_range_image) ++dropped_images;
+    pending_range_image = range_image;
+    range_image_queued.notify_one();
+  }
+  return;
+}
+
+void VelodynePuckDecoder::publishVoxelCloud() {
+  sensor_msgs::PointCloud2Ptr voxel_cloud = voxel_cloud_pool.acquire();
+  voxel_writer.reset(*voxel_cloud, 1, voxel_grid.size());
+  for (size_t i = 0; i < voxel_grid.size(); ++i) {
+    const VoxelGrid::Voxel& voxel = voxel_grid[i];
+    float scale = 1.0f / voxel.count;
+    voxel_writer.add(0).set(voxel.x*scale, voxel.y*scale, voxel.z*scale,
+        voxel.intensity*scale, 0, 0.0f);
+  }
+  voxel_writer.finish();
+
+  if (voxel_grid.droppedCount() > 0)
+    ROS_WARN_THROTTLE(1.0, "Voxel grid is full, %lu points dropped",
+        voxel_grid.droppedCount());
 
+  voxel_cloud->header.stamp.fromNSec(sweep_start_ns);
+  voxel_cloud->header.frame_id = child_frame_id;
+  voxel_cloud_pub.publish(voxel_cloud);
   return;
 }
 
-void VelodynePuckDecoder::decodePacket(const RawPacket* packet) {
+void VelodynePuckDecoder::publishGroundClouds() {
+  ground_writer.finish();
+  obstacle_writer.finish();
+  ground_cloud->header.stamp.fromNSec(sweep_start_ns);
+  ground_cloud->header.frame_id = child_frame_id;
+  obstacle_cloud->header = ground_cloud->header;
+  ground_cloud_pub.publish(ground_cloud);
+  obstacle_cloud_pub.publish(obstacle_cloud);
+
+  last_ground_time = ground_time;
+  last_ground_points = ground_cloud->width;
+  last_obstacle_points = obstacle_cloud->width;
+  ROS_DEBUG("Ground segmented in %.3f ms, %lu ground points.",
+      ground_time*1e3, last_ground_points);
+  return;
+}
+
+void VelodynePuckDecoder::publishSector() {
+  sector_writer.finish();
+  sector->header.frame_id = child_frame_id;
+  sector->cloud.header = sector->header;
+  sector_pub.publish(sector);
+  sector.reset();
+  return;
+}
+
+template <typename Traits>
+void VelodynePuckDecoder::decodePacket(
+    const RawPacket* packet, FiringBuffer& firings) {
+  static const size_t LASERS = Traits::LASERS;
+  static const size_t FIRINGS_PER_BLOCK = SCANS_PER_BLOCK / LASERS;
+  static const size_t FIRINGS_PER_PACKET =
+    FIRINGS_PER_BLOCK * BLOCKS_PER_PACKET;
+
+  // In dual return mode, each pair of blocks holds the two returns of
+  // the same firings. The azimuths are computed for the firings of the
+  // sensor first, and the returns are buffered next to each other.
+  const size_t returns = returns_per_firing;
+  const size_t sensor_firings = FIRINGS_PER_PACKET / returns;
 
   // Compute the azimuth angle for each firing.
-  for (size_t fir_idx = 0; fir_idx < FIRINGS_PER_PACKET; fir_idx+=2) {
-    size_t blk_idx = fir_idx / 2;
-    firings[fir_idx].firing_azimuth = rawAzimuthToDouble(
-        packet->blocks[blk_idx].rotation);
+  for (size_t blk_idx = 0; blk_idx < BLOCKS_PER_PACKET; blk_idx += returns) {
+    size_t fir_idx = blk_idx / returns * FIRINGS_PER_BLOCK;
+    firings.firing_azimuth[fir_idx] = packet->blocks[blk_idx].rotation;
   }
 
-  // Interpolate the azimuth values
-  for (size_t fir_idx = 1; fir_idx < FIRINGS_PER_PACKET; fir_idx+=2) {
+  // Interpolate the azimuth values of the second firing within
+  // each block, if the sensor fires twice per block.
+  for (size_t fir_idx = 1; FIRINGS_PER_BLOCK == 2 &&
+      fir_idx < sensor_firings; fir_idx+=2) {
     size_t lfir_idx = fir_idx - 1;
     size_t rfir_idx = fir_idx + 1;
 
-    if (fir_idx == FIRINGS_PER_PACKET - 1) {
+    if (fir_idx == sensor_firings - 1) {
       lfir_idx = fir_idx - 3;
       rfir_idx = fir_idx - 1;
     }
 
-    double azimuth_diff = firings[rfir_idx].firing_azimuth -
-      firings[lfir_idx].firing_azimuth;
-    azimuth_diff = azimuth_diff < 0 ? azimuth_diff + 2*M_PI : azimuth_diff;
+    int azimuth_diff = static_cast<int>(firings.firing_azimuth[rfir_idx]) -
+      firings.firing_azimuth[lfir_idx];
+    azimuth_diff = azimuth_diff < 0 ?
+      azimuth_diff + RAW_AZIMUTH_COUNT : azimuth_diff;
 
-    firings[fir_idx].firing_azimuth =
-      firings[fir_idx-1].firing_azimuth + azimuth_diff/2.0;
-    firings[fir_idx].firing_azimuth  =
-      firings[fir_idx].firing_azimuth > 2*M_PI ?
-      firings[fir_idx].firing_azimuth-2*M_PI : firings[fir_idx].firing_azimuth;
+    int firing_azimuth =
+      firings.firing_azimuth[fir_idx-1] + (azimuth_diff+1)/2;
+    firings.firing_azimuth[fir_idx] = firing_azimuth >= RAW_AZIMUTH_COUNT ?
+      firing_azimuth-RAW_AZIMUTH_COUNT : firing_azimuth;
   }
 
   // Fill in the distance and intensity for each firing.
@@ -159,63 +593,836 @@ void VelodynePuckDecoder::decodePacket(const RawPacket* packet) {
     const RawBlock& raw_block = packet->blocks[blk_idx];
 
     for (size_t blk_fir_idx = 0; blk_fir_idx < FIRINGS_PER_BLOCK; ++blk_fir_idx){
-      size_t fir_idx = blk_idx*FIRINGS_PER_BLOCK + blk_fir_idx;
+      size_t sensor_fir_idx =
+        blk_idx / returns * FIRINGS_PER_BLOCK + blk_fir_idx;
+      size_t fir_idx = sensor_fir_idx * returns + blk_idx % returns;
 
-      double azimuth_diff = 0.0;
-      if (fir_idx < FIRINGS_PER_PACKET - 1)
-        azimuth_diff = firings[fir_idx+1].firing_azimuth -
-          firings[fir_idx].firing_azimuth;
+      int azimuth_diff = 0;
+      if (sensor_fir_idx < sensor_firings - 1)
+        azimuth_diff = static_cast<int>(
+            firings.firing_azimuth[sensor_fir_idx+1]) -
+          firings.firing_azimuth[sensor_fir_idx];
       else
-        azimuth_diff = firings[fir_idx].firing_azimuth -
-          firings[fir_idx-1].firing_azimuth;
+        azimuth_diff = static_cast<int>(
+            firings.firing_azimuth[sensor_fir_idx]) -
+          firings.firing_azimuth[sensor_fir_idx-1];
+      azimuth_diff = azimuth_diff < 0 ?
+        azimuth_diff + RAW_AZIMUTH_COUNT : azimuth_diff;
 
-      for (size_t scan_fir_idx = 0; scan_fir_idx < SCANS_PER_FIRING; ++scan_fir_idx){
+      for (size_t scan_fir_idx = 0; scan_fir_idx < LASERS; ++scan_fir_idx){
         size_t byte_idx = RAW_SCAN_SIZE * (
-            SCANS_PER_FIRING*blk_fir_idx + scan_fir_idx);
+            LASERS*blk_fir_idx + scan_fir_idx);
+        size_t shot_idx = fir_idx*LASERS + scan_fir_idx;
 
-        // Azimuth
-        firings[fir_idx].azimuth[scan_fir_idx] = firings[fir_idx].firing_azimuth +
-          (scan_fir_idx*DSR_TOFFSET/FIRING_TOFFSET) * azimuth_diff;
+        // Azimuth with the rotation correction of the laser,
+        // rounded to the resolution of the rotation.
+        uint32_t azimuth = firings.firing_azimuth[sensor_fir_idx] +
+          laser_azimuth_offset[scan_fir_idx] +
+          ((shot_azimuth_fraction[scan_fir_idx]*azimuth_diff +
+            FIXED_POINT_ONE/2) >> FIXED_POINT_SHIFT);
+        firings.azimuth[shot_idx] = azimuth % RAW_AZIMUTH_COUNT;
 
         // Distance
         TwoBytes raw_distance;
         raw_distance.bytes[0] = raw_block.data[byte_idx];
         raw_distance.bytes[1] = raw_block.data[byte_idx+1];
-        firings[fir_idx].distance[scan_fir_idx] = static_cast<double>(
-            raw_distance.distance) * DISTANCE_RESOLUTION;
+        firings.distance[shot_idx] = raw_distance.distance;
 
         // Intensity
-        firings[fir_idx].intensity[scan_fir_idx] = static_cast<double>(
-            raw_block.data[byte_idx+2]);
+        firings.intensity[shot_idx] = raw_block.data[byte_idx+2];
       }
     }
   }
+
+  // Spread the azimuth of each firing over its returns, from the
+  // last one so that the azimuths are not overwritten before use.
+  for (size_t fir_idx = FIRINGS_PER_PACKET; returns > 1 && fir_idx-- > 0;)
+    firings.firing_azimuth[fir_idx] =
+      firings.firing_azimuth[fir_idx / returns];
   return;
 }
 
-void VelodynePuckDecoder::packetCallback(
-    const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg) {
+// The benchmarks decode the packets of each model directly.
+template void VelodynePuckDecoder::decodePacket<VLP16Traits>(
+    const RawPacket* packet, FiringBuffer& firings);
+template void VelodynePuckDecoder::decodePacket<PuckHiResTraits>(
+    const RawPacket* packet, FiringBuffer& firings);
+template void VelodynePuckDecoder::decodePacket<VLP32CTraits>(
+    const RawPacket* packet, FiringBuffer& firings);
+
+template <typename Traits>
+void VelodynePuckDecoder::convertPacket(FiringBuffer& firings) {
+#ifdef VELODYNE_PUCK_FIXED_POINT
+  convertToXyzFixed(firings.distance, firings.azimuth,
+      laser_factors, azimuth_table,
+      static_cast<float>(DISTANCE_RESOLUTION),
+      SCANS_PER_PACKET/Traits::LASERS, Traits::LASERS,
+      firings.x, firings.y, firings.z);
+#else
+  convertToXyz(firings.distance, firings.azimuth,
+      laser_factors, azimuth_table,
+      SCANS_PER_PACKET/Traits::LASERS, Traits::LASERS,
+      firings.x, firings.y, firings.z);
+#endif
+  return;
+}
+
+bool VelodynePuckDecoder::processPacket(
+    const velodyne_puck_msgs::VelodynePuckPacket& msg, FiringBuffer& firings) {
 
   // Convert the msg to the raw packet type.
-  const RawPacket* raw_packet = (const RawPacket*) (&(msg->data[0]));
+  const RawPacket* raw_packet = (const RawPacket*) (&(msg.data[0]));
 
   // Check if the packet is valid
-  if (!checkPacketValidity(raw_packet)) return;
+  if (!checkPacketValidity(raw_packet)) return false;
+  ros::WallTime start_time;
+  if (trace_latency) start_time = ros::WallTime::now();
+
+  // Decode the packet, and convert all the points to xyz, with
+  // the loops specialized for the sensor model.
+  switch (sensor.model) {
+    case VLP16:
+      decodePacket<VLP16Traits>(raw_packet, firings);
+      break;
+    case PUCK_HI_RES:
+      decodePacket<PuckHiResTraits>(raw_packet, firings);
+      break;
+    case VLP32C:
+      decodePacket<VLP32CTraits>(raw_packet, firings);
+      break;
+    default:
+      return false;
+  }
+
+  // The conversion is skipped if no output needs xyz. A packet decoded
+  // before a subscriber connects is converted by the assembly instead.
+  firings.has_xyz = false;
+  if (convert_xyz) convertFirings(firings);
 
-  // Decode the packet
-  decodePacket(raw_packet);
+  if (trace_latency)
+    recordLatency(DECODE, (ros::WallTime::now() - start_time).toNSec());
+  return true;
+}
+
+void VelodynePuckDecoder::convertFirings(FiringBuffer& firings) {
+  switch (sensor.model) {
+    case VLP16:
+      convertPacket<VLP16Traits>(firings);
+      break;
+    case PUCK_HI_RES:
+      convertPacket<PuckHiResTraits>(firings);
+      break;
+    case VLP32C:
+      convertPacket<VLP32CTraits>(firings);
+      break;
+    default:
+      return;
+  }
+  firings.has_xyz = true;
+  return;
+}
+
+void VelodynePuckDecoder::sweepPoolDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  // The pools of all the outputs, the ground and obstacle clouds
+  // sharing one pool.
+  const char* pool_names[OUTPUT_POOLS] = {"Sweep", "Cloud", "Range image",
+    "Compressed range image", "Sector", "Voxel cloud", "Ground cloud"};
+  const size_t exhausted_counts[OUTPUT_POOLS] = {
+    sweep_pool.exhaustedCount(),
+    cloud_pool.exhaustedCount(),
+    range_image_pool.exhaustedCount(),
+    compressed_range_image_pool.exhaustedCount(),
+    sector_pool.exhaustedCount(),
+    voxel_cloud_pool.exhaustedCount(),
+    ground_cloud_pool.exhaustedCount()};
+
+  std::string exhausted_pools;
+  for (size_t pool_idx = 0; pool_idx < OUTPUT_POOLS; ++pool_idx) {
+    if (exhausted_counts[pool_idx] <= reported_exhausted_counts[pool_idx])
+      continue;
+    if (!exhausted_pools.empty()) exhausted_pools += ", ";
+    exhausted_pools += pool_names[pool_idx];
+    reported_exhausted_counts[pool_idx] = exhausted_counts[pool_idx];
+  }
+  if (!exhausted_pools.empty())
+    status.summary(diagnostic_msgs::DiagnosticStatus::WARN,
+        "Pool exhausted, subscribers hold on to messages: " +
+        exhausted_pools);
+  else
+    status.summary(diagnostic_msgs::DiagnosticStatus::OK,
+        "Messages are recycled");
+
+  status.add("Pool capacity", sweep_pool.getCapacity());
+  status.add("Pool size", sweep_pool.size());
+  status.add("Sweeps in use", sweep_pool.inUse());
+  status.add("Cloud pool size", cloud_pool.size());
+  status.add("Clouds in use", cloud_pool.inUse());
+  for (size_t pool_idx = 0; pool_idx < OUTPUT_POOLS; ++pool_idx)
+    status.add(std::string(pool_names[pool_idx]) +
+        " pool exhausted count", exhausted_counts[pool_idx]);
+  status.add("Allocations in last sweep", sweep_allocations);
+  return;
+}
+
+void VelodynePuckDecoder::groundDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  status.summary(diagnostic_msgs::DiagnosticStatus::OK,
+      "Ground segmented");
+  status.add("Time in last sweep [ms]", last_ground_time*1e3);
+  status.add("Ground points in last sweep", last_ground_points);
+  status.add("Obstacle points in last sweep", last_obstacle_points);
+  return;
+}
+
+void VelodynePuckDecoder::deskewDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  if (skipped_deskew_packets > 0)
+    status.summaryf(diagnostic_msgs::DiagnosticStatus::WARN,
+        "%lu packets not deskewed", skipped_deskew_packets);
+  else if (latest_deskew_poses > 0)
+    status.summaryf(diagnostic_msgs::DiagnosticStatus::WARN,
+        "tf lags behind, %lu poses replaced by the latest one",
+        latest_deskew_poses);
+  else
+    status.summary(diagnostic_msgs::DiagnosticStatus::OK,
+        "Points deskewed");
+
+  status.add("Packets not deskewed", skipped_deskew_packets);
+  status.add("Poses replaced by the latest one", latest_deskew_poses);
+  skipped_deskew_packets = 0;
+  latest_deskew_poses = 0;
+  return;
+}
+
+void VelodynePuckDecoder::timingDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  if (phase_lock && unlocked_sweeps > 0)
+    status.summaryf(diagnostic_msgs::DiagnosticStatus::WARN,
+        "%lu sweeps off the phase lock", unlocked_sweeps);
+  else
+    status.summaryf(diagnostic_msgs::DiagnosticStatus::OK,
+        "Sweeps cut at %.2f degrees", cut_azimuth*0.01);
+
+  status.add("Cut angle [deg]", cut_azimuth*0.01);
+  status.add("Phase lock", phase_lock);
+  status.add("Sweeps", latency_count);
+  status.add("Mean latency [ms]",
+      latency_count > 0 ? latency_sum/latency_count*1e3 : 0.0);
+  status.add("Max latency [ms]", latency_max*1e3);
+  if (phase_lock) {
+    status.add("Max phase error [ms]", phase_error_max*1e-6);
+    status.add("Sweeps off the phase lock", unlocked_sweeps);
+  }
+
+  latency_sum = 0.0;
+  latency_max = 0.0;
+  latency_count = 0;
+  phase_error_max = 0;
+  unlocked_sweeps = 0;
+  return;
+}
+
+void VelodynePuckDecoder::assemblyDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  if (incomplete_sweeps > 0)
+    status.summaryf(diagnostic_msgs::DiagnosticStatus::WARN,
+        "%lu incomplete sweeps", incomplete_sweeps);
+  else
+    status.summary(diagnostic_msgs::DiagnosticStatus::OK,
+        "Sweeps are complete");
+
+  status.add("Sweep timeout [s]", sweep_timeout);
+  status.add("Min completeness [%]", min_completeness*100.0f);
+  status.add("Incomplete sweeps", incomplete_sweeps);
+  status.add("Missing firings", missing_firings);
+  status.add("Sweeps closed on the time budget", timed_out_sweeps);
+  status.add("Sweeps flushed without packets", flushed_sweeps);
+
+  missing_firings = 0;
+  incomplete_sweeps = 0;
+  timed_out_sweeps = 0;
+  flushed_sweeps = 0;
+  min_completeness = 1.0f;
+  return;
+}
+
+void VelodynePuckDecoder::latencyDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  boost::lock_guard<boost::mutex> lock(latency_mutex);
+  status.summary(diagnostic_msgs::DiagnosticStatus::OK,
+      latency_report.stages.empty() ? "No latency report yet" :
+      "Latency of the stages of the pipeline");
+
+  status.add("Report period [s]", latency_report_period);
+  for (size_t stage_idx = 0; stage_idx < latency_report.stages.size();
+      ++stage_idx) {
+    const velodyne_puck_msgs::VelodynePuckLatencyStage& stage =
+      latency_report.stages[stage_idx];
+    if (stage.count == 0) continue;
+    status.addf(stage.name + " p50/p99/max [ms]", "%.3f / %.3f / %.3f",
+        stage.p50*1e3, stage.p99*1e3, stage.max*1e3);
+  }
+  return;
+}
+
+uint64_t VelodynePuckDecoder::sweepStamp(const uint64_t& stamp_ns) {
+  if (!phase_lock) return stamp_ns;
+
+  // The phase locked sensor passes the cut angle at the top of
+  // each second, and once per rotation period after that.
+  static const uint64_t NSEC_PER_SEC = 1000000000ull;
+  uint64_t second_ns = stamp_ns - stamp_ns%NSEC_PER_SEC;
+  uint64_t locked_ns = second_ns + (stamp_ns-second_ns +
+      rotation_period_ns/2) / rotation_period_ns * rotation_period_ns;
+  int64_t phase_error = std::abs(static_cast<int64_t>(stamp_ns-locked_ns));
+  phase_error_max = std::max(phase_error_max, phase_error);
+
+  // Keep the measured stamp if the sensor is clearly not locked
+  // to the cut angle, e.g. without a PPS signal.
+  if (phase_error > static_cast<int64_t>(rotation_period_ns/10)) {
+    ++unlocked_sweeps;
+    ROS_WARN_THROTTLE(1.0, "Sweep is %.2f ms off the phase lock. Check the "
+        "PPS signal, and the phase lock offset against cut_angle.",
+        phase_error*1e-6);
+    return stamp_ns;
+  }
+  return locked_ns;
+}
+
+void VelodynePuckDecoder::updateOutputs() {
+  point_cloud_enabled = publish_point_cloud &&
+    point_cloud_pub.getNumSubscribers() > 0;
+  sweep_enabled = sweep_pub.getNumSubscribers() > 0;
+  compressed_range_image_enabled = publish_range_image &&
+    compressed_range_image_pub.getNumSubscribers() > 0;
+  range_image_enabled = publish_range_image &&
+    (range_image_pub.getNumSubscribers() > 0 ||
+     compressed_range_image_enabled);
+  sector_enabled = sector_angle > 0.0 &&
+    sector_pub.getNumSubscribers() > 0;
+  voxel_cloud_enabled = voxel_leaf_size > 0.0 &&
+    voxel_cloud_pub.getNumSubscribers() > 0;
+  ground_enabled = segment_ground &&
+    (ground_cloud_pub.getNumSubscribers() > 0 ||
+     obstacle_cloud_pub.getNumSubscribers() > 0);
+
+  xyz_enabled = sweep_enabled || point_cloud_enabled || sector_enabled ||
+    voxel_cloud_enabled || ground_enabled;
+  if (xyz_enabled != convert_xyz)
+    ROS_DEBUG("%s the conversion to xyz.",
+        xyz_enabled ? "Resuming" : "Pausing");
+  convert_xyz = xyz_enabled;
+  return;
+}
+
+void VelodynePuckDecoder::compressionDiagnostics(
+    diagnostic_updater::DiagnosticStatusWrapper& status) {
+  boost::lock_guard<boost::mutex> lock(compression_mutex);
+  if (dropped_images > 0)
+    status.summaryf(diagnostic_msgs::DiagnosticStatus::WARN,
+        "%lu range images dropped, the compression is too slow",
+        dropped_images);
+  else
+    status.summary(diagnostic_msgs::DiagnosticStatus::OK,
+        "Range images compressed");
+
+  status.add("Compression level", compression_level);
+  status.add("Compressed images", compressed_images);
+  status.add("Dropped images", dropped_images);
+  status.add("Compression ratio", compressed_bytes > 0 ?
+      static_cast<double>(uncompressed_bytes)/compressed_bytes : 0.0);
+  status.add("Mean encode time [ms]", compressed_images > 0 ?
+      encode_time/compressed_images*1e3 : 0.0);
+  status.add("Max encode time [ms]", max_encode_time*1e3);
+
+  compressed_images = 0;
+  dropped_images = 0;
+  uncompressed_bytes = 0;
+  compressed_bytes = 0;
+  encode_time = 0.0;
+  max_encode_time = 0.0;
+  return;
+}
+
+void VelodynePuckDecoder::resetSweep() {
+  // The outputs are switched on and off between sweeps only,
+  // so a new subscriber never gets a partial sweep.
+  updateOutputs();
+  sweep_allocations = 0;
+
+  // Fill in the altitude for each scan, and make sure the storage
+  // of a recycled sweep still fits a full revolution, so that no
+  // reallocation happens while the sweep is assembled.
+  if (sweep_enabled) {
+    sweep_data = sweep_pool.acquire();
+    sweep_data->scans.resize(lasers);
+    for (size_t scan_idx = 0; scan_idx < lasers; ++scan_idx) {
+      size_t remapped_scan_idx = laser_rings[scan_idx];
+      velodyne_puck_msgs::VelodynePuckScan& scan =
+        sweep_data->scans[remapped_scan_idx];
+      scan.altitude = calibration.lasers[scan_idx].vert_correction;
+      if (scan.points.capacity() < max_points_per_scan) ++sweep_allocations;
+      scan.points.resize(
+          std::max(scan.points.capacity(), max_points_per_scan));
+      scan_sizes[remapped_scan_idx] = 0;
+    }
+  } else {
+    sweep_data.reset();
+  }
+
+  if (point_cloud_enabled) {
+    point_cloud = cloud_pool.acquire();
+    if (organized_point_cloud)
+      cloud_writer.resetOrganized(*point_cloud,
+          lasers, cloud_columns);
+    else
+      cloud_writer.reset(*point_cloud,
+          lasers, max_points_per_scan);
+  }
+
+  if (range_image_enabled) resetRangeImage();
+  if (voxel_cloud_enabled) voxel_grid.reset();
+
+  if (ground_enabled) {
+    ground_cloud = ground_cloud_pool.acquire();
+    obstacle_cloud = ground_cloud_pool.acquire();
+    ground_writer.reset(*ground_cloud, lasers, max_points_per_scan);
+    obstacle_writer.reset(*obstacle_cloud, lasers, max_points_per_scan);
+    ground_time = 0.0;
+  }
+  return;
+}
+
+void VelodynePuckDecoder::resetRangeImage() {
+  range_image = range_image_pool.acquire();
+  range_image_width = 0;
+  // One column per firing, with the first of its returns.
+  range_image_capacity = max_points_per_scan / returns_per_firing;
+
+  range_image->height = lasers;
+  range_image->distance_resolution = DISTANCE_RESOLUTION;
+  range_image->altitude.resize(lasers);
+  range_image->row_time_offset.resize(lasers);
+  range_image->rot_correction.resize(lasers);
+  range_image->dist_correction.resize(lasers);
+  range_image->vert_offset_correction.resize(lasers);
+  range_image->horiz_offset_correction.resize(lasers);
+  for (size_t scan_idx = 0; scan_idx < lasers; ++scan_idx) {
+    size_t remapped_scan_idx = laser_rings[scan_idx];
+    const LaserCorrection& laser = calibration.lasers[scan_idx];
+    range_image->altitude[remapped_scan_idx] = laser.vert_correction;
+    range_image->row_time_offset[remapped_scan_idx] =
+      sensor.time_offset[scan_idx] * 1e-6;
+    range_image->rot_correction[remapped_scan_idx] = laser.rot_correction;
+    range_image->dist_correction[remapped_scan_idx] = laser.dist_correction;
+    range_image->vert_offset_correction[remapped_scan_idx] =
+      laser.vert_offset_correction;
+    range_image->horiz_offset_correction[remapped_scan_idx] =
+      laser.horiz_offset_correction;
+  }
+
+  range_image->range.resize(lasers*range_image_capacity);
+  range_image->intensity.resize(lasers*range_image_capacity);
+  range_image->azimuth.resize(range_image_capacity);
+  range_image->time.resize(range_image_capacity);
+  return;
+}
+
+void VelodynePuckDecoder::fillRangeImage(const FiringBuffer& firings,
+    const size_t& start_fir_idx, const size_t& end_fir_idx) {
+  for (size_t fir_idx = start_fir_idx; fir_idx < end_fir_idx;
+      fir_idx += returns_per_firing) {
+    if (range_image_width == range_image_capacity) {
+      ROS_WARN_THROTTLE(1.0, "Range image exceeds the expected %lu "
+          "columns. Check the frequency parameter.", range_image_capacity);
+      return;
+    }
+    size_t column = range_image_width++;
+
+    range_image->azimuth[column] = firings.firing_azimuth[fir_idx];
+    range_image->time[column] = (packet_start_offset +
+        firing_time_offset[fir_idx-start_fir_idx]) * 1e-9;
+
+    for (size_t scan_idx = 0; scan_idx < lasers; ++scan_idx) {
+      size_t shot_idx = fir_idx*lasers + scan_idx;
+      size_t remapped_scan_idx = laser_rings[scan_idx];
+      size_t pixel_idx = remapped_scan_idx*range_image_capacity + column;
+
+      range_image->range[pixel_idx] = isPointInRange(
+          firings.distance[shot_idx]) ? firings.distance[shot_idx] : 0;
+      range_image->intensity[pixel_idx] = firings.intensity[shot_idx];
+    }
+  }
+  return;
+}
+
+void VelodynePuckDecoder::updateSector(const FiringBuffer& firings,
+    const size_t& fir_idx, const uint32_t& firing_offset) {
+  size_t sector_index = std::min(sectors_per_sweep-1, static_cast<size_t>(
+        cutRelativeAzimuth(firings.firing_azimuth[fir_idx]) *
+        sectors_per_raw_azimuth));
+  if (sector && sector->sector_index == sector_index) return;
+
+  // The firing starts a new sector.
+  if (sector) publishSector();
+  sector = sector_pool.acquire();
+  sector->header.stamp.fromNSec(sweep_start_ns + firing_offset);
+  sector->sector_index = sector_index;
+  sector->sectors_per_sweep = sectors_per_sweep;
+  // The end of a sector past azimuth 0 exceeds 2 pi.
+  double start_degrees = fmod(cut_azimuth*0.01 + sector_index*sector_angle,
+      360.0);
+  sector->start_azimuth = start_degrees * DEG_TO_RAD;
+  sector->end_azimuth = (start_degrees + std::min(sector_angle,
+        360.0 - sector_index*sector_angle)) * DEG_TO_RAD;
+  sector_start_offset = firing_offset;
+  sector_writer.reset(sector->cloud, lasers, sector_capacity);
+  return;
+}
+
+void VelodynePuckDecoder::lookupSensorPose(const ros::Time& time,
+    tf::StampedTransform& pose) {
+  // The assembly runs in the packet callback, or holds up the
+  // decode pipeline, so it never waits for tf to catch up.
+  if (tf_listener->canTransform(fixed_frame_id, child_frame_id, time)) {
+    tf_listener->lookupTransform(fixed_frame_id, child_frame_id, time, pose);
+    return;
+  }
+  tf_listener->lookupTransform(fixed_frame_id, child_frame_id,
+      ros::Time(0), pose);
+  ++latest_deskew_poses;
+  return;
+}
+
+void VelodynePuckDecoder::deskewFirings(FiringBuffer& firings,
+    const size_t& start_fir_idx, const size_t& end_fir_idx) {
+  ros::Time sweep_time, start_time, end_time;
+  sweep_time.fromNSec(sweep_start_ns);
+  start_time.fromNSec(sweep_start_ns + packet_start_offset);
+  end_time.fromNSec(sweep_start_ns + packet_start_offset +
+      firing_time_offset[end_fir_idx-start_fir_idx]);
+
+  // Poses of the sensor at the start of the sweep, and at
+  // the start and the end of the firings.
+  tf::StampedTransform start_pose;
+  tf::StampedTransform end_pose;
+  try {
+    if (!deskew_reference_valid) {
+      tf::StampedTransform reference;
+      lookupSensorPose(sweep_time, reference);
+      deskew_reference_inverse = reference.inverse();
+      deskew_reference_valid = true;
+    }
+    lookupSensorPose(start_time, start_pose);
+    lookupSensorPose(end_time, end_pose);
+  } catch (const tf::TransformException& e) {
+    ROS_WARN_THROTTLE(1.0, "Points are not deskewed: %s", e.what());
+    ++skipped_deskew_packets;
+    return;
+  }
+
+  // Interpolate the pose of each firing, and move its
+  // points to the pose at the start of the sweep.
+  for (size_t fir_idx = start_fir_idx; fir_idx < end_fir_idx; ++fir_idx) {
+    double ratio = static_cast<double>(fir_idx-start_fir_idx) /
+      (end_fir_idx-start_fir_idx);
+    tf::Transform firing_pose(
+        start_pose.getRotation().slerp(end_pose.getRotation(), ratio),
+        start_pose.getOrigin().lerp(end_pose.getOrigin(), ratio));
+    tf::Transform correction = deskew_reference_inverse * firing_pose;
+
+    const tf::Matrix3x3 rotation = correction.getBasis();
+    const tf::Vector3& translation = correction.getOrigin();
+    float r[3][3];
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) r[i][j] = rotation[i][j];
+    float t[3] = {static_cast<float>(translation.x()),
+      static_cast<float>(translation.y()), static_cast<float>(translation.z())};
+
+    float* x = &firings.x[fir_idx*lasers];
+    float* y = &firings.y[fir_idx*lasers];
+    float* z = &firings.z[fir_idx*lasers];
+    for (size_t scan_idx = 0; scan_idx < lasers; ++scan_idx) {
+      float px = x[scan_idx];
+      float py = y[scan_idx];
+      float pz = z[scan_idx];
+      x[scan_idx] = r[0][0]*px + r[0][1]*py + r[0][2]*pz + t[0];
+      y[scan_idx] = r[1][0]*px + r[1][1]*py + r[1][2]*pz + t[1];
+      z[scan_idx] = r[2][0]*px + r[2][1]*py + r[2][2]*pz + t[2];
+    }
+  }
+  return;
+}
+
+void VelodynePuckDecoder::labelGround(FiringBuffer& firings,
+    const size_t& start_fir_idx, const size_t& end_fir_idx) {
+  ros::WallTime start_time = ros::WallTime::now();
+
+  for (size_t fir_idx = start_fir_idx; fir_idx < end_fir_idx; ++fir_idx) {
+    // Each column starts from the ground below the sensor.
+    float last_distance = 0.0f;
+    float last_z = static_cast<float>(-sensor_height);
+    bool last_ground = true;
+
+    for (size_t ring = 0; ring < lasers; ++ring) {
+      size_t shot_idx = fir_idx*lasers + ring_lasers[ring];
+      firings.ground[shot_idx] = 0;
+      if (!isPointInRange(firings.distance[shot_idx])) continue;
+
+      float horizontal_distance = std::sqrt(
+          firings.x[shot_idx]*firings.x[shot_idx] +
+          firings.y[shot_idx]*firings.y[shot_idx]);
+      float rise = std::fabs(firings.z[shot_idx] - last_z);
+      float run = horizontal_distance - last_distance;
+      bool ground = last_ground && run > 0.0f &&
+        rise <= ground_slope_tan*run;
+
+      firings.ground[shot_idx] = ground;
+      last_distance = horizontal_distance;
+      last_z = firings.z[shot_idx];
+      last_ground = ground;
+    }
+  }
+
+  ground_time += (ros::WallTime::now() - start_time).toSec();
+  return;
+}
+
+void VelodynePuckDecoder::fillSweep(FiringBuffer& firings,
+    const size_t& start_fir_idx, const size_t& end_fir_idx) {
+  if (range_image_enabled)
+    fillRangeImage(firings, start_fir_idx, end_fir_idx);
+
+  // Without subscribers to the xyz outputs, the firings only
+  // advance the time of the sweep.
+  size_t xyz_end_fir_idx = xyz_enabled ? end_fir_idx : start_fir_idx;
+  if (xyz_enabled) {
+    if (!firings.has_xyz) convertFirings(firings);
+    if (deskew && end_fir_idx > start_fir_idx)
+      deskewFirings(firings, start_fir_idx, end_fir_idx);
+    if (ground_enabled)
+      labelGround(firings, start_fir_idx, end_fir_idx);
+  }
+
+  for (size_t fir_idx = start_fir_idx; fir_idx < xyz_end_fir_idx; ++fir_idx) {
+    uint32_t firing_offset = packet_start_offset +
+      firing_time_offset[fir_idx-start_fir_idx];
+    if (sector_enabled) updateSector(firings, fir_idx, firing_offset);
+
+    for (size_t scan_idx = 0; scan_idx < lasers; ++scan_idx) {
+      size_t shot_idx = fir_idx*lasers + scan_idx;
+
+      // Check if the point is valid.
+      if (!isPointInRange(firings.distance[shot_idx])) continue;
+
+      const float& x_coord = firings.x[shot_idx];
+      const float& y_coord = firings.y[shot_idx];
+      const float& z_coord = firings.z[shot_idx];
+
+      // Time of the point from the start of the sweep [ns]
+      uint32_t time_offset = firing_offset + laser_time_offset[scan_idx];
+      float time = time_offset * 1e-9f;
+
+      // Remap the index of the scan
+      size_t remapped_scan_idx = laser_rings[scan_idx];
+
+      if (sweep_enabled) {
+        std::vector<velodyne_puck_msgs::VelodynePuckPoint>& points =
+          sweep_data->scans[remapped_scan_idx].points;
+
+        // The storage is sized for a full revolution at the configured
+        // frequency. It only grows if the sensor spins slower than that,
+        // up to the firings within the time budget of a sweep.
+        if (scan_sizes[remapped_scan_idx] == points.size()) {
+          ROS_WARN_THROTTLE(1.0, "Sweep exceeds the expected %lu points "
+              "per scan. Check the frequency parameter.", max_points_per_scan);
+          points.resize(std::min(2*points.size(), max_sweep_firings));
+          ++sweep_allocations;
+        }
+        velodyne_puck_msgs::VelodynePuckPoint& new_point =
+          points[scan_sizes[remapped_scan_idx]++];
+
+        // Pack the data into point msg
+        new_point.time_offset = time_offset;
+        new_point.x = x_coord;
+        new_point.y = y_coord;
+        new_point.z = z_coord;
+        new_point.azimuth = rawAzimuthToFloat(firings.azimuth[shot_idx]);
+        new_point.distance = firings.distance[shot_idx] * DISTANCE_RESOLUTION;
+        new_point.intensity = firings.intensity[shot_idx];
+      }
+
+      // The organized cloud has one cell per firing, which takes
+      // the first of its returns, as the range image.
+      if (point_cloud_enabled &&
+          (!organized_point_cloud || fir_idx % returns_per_firing == 0)) {
+        CloudPoint& point = organized_point_cloud ?
+          cloud_writer.at(remapped_scan_idx,
+              azimuthToColumn(firings.azimuth[shot_idx])) :
+          cloud_writer.add(remapped_scan_idx);
+        point.set(x_coord, y_coord, z_coord,
+            firings.intensity[shot_idx], remapped_scan_idx, time);
+        point.setTimestamp(sweep_start_ns + time_offset);
+      }
+
+      if (ground_enabled)
+        (firings.ground[shot_idx] ? ground_writer : obstacle_writer).add(
+            remapped_scan_idx).set(x_coord, y_coord, z_coord,
+            firings.intensity[shot_idx], remapped_scan_idx, time);
+
+      if (voxel_cloud_enabled) voxel_grid.add(x_coord, y_coord, z_coord,
+          firings.intensity[shot_idx]);
+
+      if (sector)
+        sector_writer.add(remapped_scan_idx).set(x_coord, y_coord, z_coord,
+            firings.intensity[shot_idx], remapped_scan_idx,
+            (time_offset-sector_start_offset)*1e-9f);
+    }
+  }
+
+  packet_start_offset += firing_time_offset[end_fir_idx-start_fir_idx];
+  sweep_firings += (end_fir_idx - start_fir_idx) / returns_per_firing;
+  return;
+}
+
+void VelodynePuckDecoder::publishSweep() {
+  ros::WallTime start_time;
+  if (trace_latency) start_time = ros::WallTime::now();
+  size_t sweep_points = 0;
+  for (size_t i = 0; i < lasers; ++i) sweep_points += scan_sizes[i];
+  VELODYNE_PUCK_DECODER_TRACE3(sweep_cut, published_sweeps,
+      sweep_start_ns, sweep_firings);
+
+  // Fraction of the revolution covered by the received firings.
+  float completeness = std::min(1.0f,
+      sweep_firings*azimuth_per_firing/RAW_AZIMUTH_COUNT);
+  min_completeness = std::min(min_completeness, completeness);
+  if (completeness < 0.99f) ++incomplete_sweeps;
+
+  if (sweep_enabled) {
+    for (size_t i = 0; i < lasers; ++i)
+      sweep_data->scans[i].points.resize(scan_sizes[i]);
+    sweep_data->header.stamp.fromNSec(sweep_start_ns);
+    sweep_data->completeness = completeness;
+    sweep_pub.publish(sweep_data);
+  }
+  if (point_cloud_enabled) publishPointCloud();
+  if (range_image_enabled) publishRangeImage();
+  if (sector) publishSector();
+  if (voxel_cloud_enabled) publishVoxelCloud();
+  if (ground_enabled) publishGroundClouds();
+  ROS_DEBUG("Sweep published with %lu buffer allocations, "
+      "%.1f%% complete.", sweep_allocations, completeness*100.0f);
+
+  // Latency of the freshest data in the sweep, i.e. its last firing.
+  ros::Time sweep_end_time;
+  sweep_end_time.fromNSec(sweep_start_ns + packet_start_offset);
+  double latency = (ros::Time::now() - sweep_end_time).toSec();
+  latency_sum += latency;
+  latency_max = std::max(latency_max, latency);
+  ++latency_count;
+
+  diagnostics.update();
+  resetSweep();
+  packet_start_offset = 0;
+  sweep_firings = 0;
+  deskew_reference_valid = false;
+  VELODYNE_PUCK_DECODER_TRACE2(sweep_publish, published_sweeps,
+      sweep_points);
+  ++published_sweeps;
+
+  if (trace_latency) {
+    int64_t publish_ns = (ros::WallTime::now() - start_time).toNSec();
+    recordLatency(SWEEP_PUBLISH, publish_ns);
+    sweep_publish_ns += publish_ns;
+    sweep_published = true;
+  }
+  return;
+}
+
+void VelodynePuckDecoder::assemblePacket(FiringBuffer& firings,
+    const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg) {
+  boost::lock_guard<boost::mutex> lock(assembly_mutex);
+  if (!trace_latency) {
+    assembleFirings(firings, msg);
+    return;
+  }
+
+  // The sweeps published by the assembly count on their own.
+  ros::WallTime start_time = ros::WallTime::now();
+  sweep_publish_ns = 0;
+  sweep_published = false;
+  assembleFirings(firings, msg);
+  recordLatency(ASSEMBLY,
+      (ros::WallTime::now() - start_time).toNSec() - sweep_publish_ns);
+
+  // Age of the packet closing a sweep once the sweep is out.
+  if (sweep_published)
+    recordLatency(END_TO_END, (ros::Time::now() - msg->stamp).toNSec());
+  return;
+}
+
+void VelodynePuckDecoder::assembleFirings(FiringBuffer& firings,
+    const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg) {
+  uint64_t packet_ns = msg->stamp.toNSec();
+  last_arrival_ns = ros::Time::now().toNSec();
+
+  // Estimate the rotation speed from the azimuth span of the packet,
+  // over the firings of the sensor rather than the buffered returns.
+  uint16_t first_azimuth = cutRelativeAzimuth(firings.firing_azimuth[0]);
+  int packet_span = static_cast<int>(cutRelativeAzimuth(
+        firings.firing_azimuth[firings_per_packet-1])) - first_azimuth;
+  if (packet_span < 0) packet_span += RAW_AZIMUTH_COUNT;
+  azimuth_per_firing = static_cast<float>(packet_span) /
+    (firings_per_packet/returns_per_firing - 1);
+
+  if (!is_first_sweep) {
+    if (sweep_flushed || packet_ns > sweep_start_ns + sweep_timeout_ns) {
+      // The sweep has not been closed within the time budget, e.g.
+      // because the packets stopped, or a whole revolution was lost.
+      // Publish what is there, and start over from this packet.
+      if (!sweep_flushed) {
+        ++timed_out_sweeps;
+        ROS_WARN_THROTTLE(1.0, "Sweep is not closed within %.3f s. "
+            "Publishing the incomplete sweep.", sweep_timeout);
+        publishSweep();
+      }
+      sweep_flushed = false;
+      sweep_start_ns = packet_ns;
+      last_azimuth = first_azimuth;
+    } else if (first_azimuth >= last_azimuth && azimuth_per_firing > 0.0f) {
+      // Count the firings lost since the last packet, and advance the
+      // time of the sweep past them.
+      size_t steps = static_cast<size_t>((first_azimuth-last_azimuth) /
+          azimuth_per_firing + 0.5);
+      if (steps > 1) {
+        missing_firings += steps-1;
+        packet_start_offset += static_cast<uint32_t>(
+            floor((steps-1)*FIRING_TOFFSET*1e3 + 0.5));
+      }
+    }
+  }
 
   // Find the start of a new revolution
   //    If there is one, new_sweep_start will be the index of the start firing,
-  //    otherwise, new_sweep_start will be FIRINGS_PER_PACKET.
+  //    otherwise, new_sweep_start will be firings_per_packet.
+  //    The sweep is also closed once it spans the time budget on the
+  //    clock of the sensor, which bounds the storage of a sweep.
   size_t new_sweep_start = 0;
+  bool over_budget = false;
   do {
-    if (firings[new_sweep_start].firing_azimuth < last_azimuth) break;
+    uint16_t azimuth =
+      cutRelativeAzimuth(firings.firing_azimuth[new_sweep_start]);
+    if (azimuth < last_azimuth) break;
+    over_budget = !is_first_sweep && packet_start_offset +
+      firing_time_offset[new_sweep_start] >= sweep_timeout_ns;
+    if (over_budget) break;
     else {
-      last_azimuth = firings[new_sweep_start].firing_azimuth;
+      last_azimuth = azimuth;
       ++new_sweep_start;
     }
-  } while (new_sweep_start < FIRINGS_PER_PACKET);
+  } while (new_sweep_start < firings_per_packet);
 
   // The first sweep may not be complete. So, the firings with
   // the first sweep will be discarded. We will wait for the
@@ -223,148 +1430,218 @@ void VelodynePuckDecoder::packetCallback(
   size_t start_fir_idx = 0;
   size_t end_fir_idx = new_sweep_start;
   if (is_first_sweep &&
-      new_sweep_start == FIRINGS_PER_PACKET) {
+      new_sweep_start == firings_per_packet) {
     // The first sweep has not ended yet.
     return;
   } else {
     if (is_first_sweep) {
       is_first_sweep = false;
       start_fir_idx = new_sweep_start;
-      end_fir_idx = FIRINGS_PER_PACKET;
-      sweep_start_time = msg->stamp.toSec() +
-        FIRING_TOFFSET * (end_fir_idx-start_fir_idx) * 1e-6;
+      end_fir_idx = firings_per_packet;
+      sweep_start_ns = sweepStamp(
+          packet_ns + firing_time_offset[start_fir_idx]);
+      last_azimuth =
+        cutRelativeAzimuth(firings.firing_azimuth[firings_per_packet-1]);
     }
   }
 
-  for (size_t fir_idx = start_fir_idx; fir_idx < end_fir_idx; ++fir_idx) {
-    for (size_t scan_idx = 0; scan_idx < SCANS_PER_FIRING; ++scan_idx) {
-      // Check if the point is valid.
-      if (!isPointInRange(firings[fir_idx].distance[scan_idx])) continue;
-
-      // Convert the point to xyz coordinate
-      size_t table_idx = floor(firings[fir_idx].azimuth[scan_idx]*1000.0+0.5);
-      //cout << table_idx << endl;
-      double cos_azimuth = cos_azimuth_table[table_idx];
-      double sin_azimuth = sin_azimuth_table[table_idx];
-
-      //double x = firings[fir_idx].distance[scan_idx] *
-      //  cos_scan_altitude[scan_idx] * sin(firings[fir_idx].azimuth[scan_idx]);
-      //double y = firings[fir_idx].distance[scan_idx] *
-      //  cos_scan_altitude[scan_idx] * cos(firings[fir_idx].azimuth[scan_idx]);
-      //double z = firings[fir_idx].distance[scan_idx] *
-      //  sin_scan_altitude[scan_idx];
-
-      double x = firings[fir_idx].distance[scan_idx] *
-        cos_scan_altitude[scan_idx] * sin_azimuth;
-      double y = firings[fir_idx].distance[scan_idx] *
-        cos_scan_altitude[scan_idx] * cos_azimuth;
-      double z = firings[fir_idx].distance[scan_idx] *
-        sin_scan_altitude[scan_idx];
-
-      double x_coord = y;
-      double y_coord = -x;
-      double z_coord = z;
-
-      // Compute the time of the point
-      double time = packet_start_time +
-        FIRING_TOFFSET*fir_idx + DSR_TOFFSET*scan_idx;
+  fillSweep(firings, start_fir_idx, end_fir_idx);
 
-      // Remap the index of the scan
-      int remapped_scan_idx = scan_idx%2 == 0 ? scan_idx/2 : scan_idx/2+8;
-      sweep_data->scans[remapped_scan_idx].points.push_back(
-          velodyne_puck_msgs::VelodynePuckPoint());
-      velodyne_puck_msgs::VelodynePuckPoint& new_point =
-        sweep_data->scans[remapped_scan_idx].points[
-        sweep_data->scans[remapped_scan_idx].points.size()-1];
-
-      // Pack the data into point msg
-      new_point.time = time;
-      new_point.x = x_coord;
-      new_point.y = y_coord;
-      new_point.z = z_coord;
-      new_point.azimuth = firings[fir_idx].azimuth[scan_idx];
-      new_point.distance = firings[fir_idx].distance[scan_idx];
-      new_point.intensity = firings[fir_idx].intensity[scan_idx];
+  // A new sweep begins
+  if (end_fir_idx != firings_per_packet) {
+    // Publish the last revolution
+    if (over_budget) {
+      ++timed_out_sweeps;
+      ROS_WARN_THROTTLE(1.0, "Sweep exceeds %.3f s without passing the "
+          "cut angle. Check the frequency parameter.", sweep_timeout);
     }
+    publishSweep();
+
+    // Prepare the next revolution. A sweep closed on the time
+    // budget does not start at the cut angle.
+    sweep_start_ns = packet_ns + firing_time_offset[end_fir_idx];
+    if (!over_budget) sweep_start_ns = sweepStamp(sweep_start_ns);
+    last_azimuth =
+      cutRelativeAzimuth(firings.firing_azimuth[firings_per_packet-1]);
+
+    start_fir_idx = end_fir_idx;
+    end_fir_idx = firings_per_packet;
+
+    fillSweep(firings, start_fir_idx, end_fir_idx);
   }
 
-  packet_start_time += FIRING_TOFFSET * (end_fir_idx-start_fir_idx);
+  return;
+}
 
-  // A new sweep begins
-  if (end_fir_idx != FIRINGS_PER_PACKET) {
-    // Publish the last revolution
-    sweep_data->header.stamp = ros::Time(sweep_start_time);
-    sweep_pub.publish(sweep_data);
-    if (publish_point_cloud) publishPointCloud();
-    sweep_data = velodyne_puck_msgs::VelodynePuckSweepPtr(
-        new velodyne_puck_msgs::VelodynePuckSweep());
+void VelodynePuckDecoder::flushCallback(const ros::TimerEvent& event) {
+  boost::lock_guard<boost::mutex> lock(assembly_mutex);
+  if (is_first_sweep || sweep_flushed || sweep_firings == 0) return;
 
-    // Prepare the next revolution
-    sweep_start_time = msg->stamp.toSec() +
-      FIRING_TOFFSET * (end_fir_idx-start_fir_idx) * 1e-6;
-    packet_start_time = 0.0;
-    last_azimuth = firings[FIRINGS_PER_PACKET-1].firing_azimuth;
+  // Publish the sweep if no packet has arrived within the time
+  // budget, instead of holding it until the packets resume.
+  uint64_t now_ns = ros::Time::now().toNSec();
+  if (now_ns < last_arrival_ns + sweep_timeout_ns) return;
 
-    start_fir_idx = end_fir_idx;
-    end_fir_idx = FIRINGS_PER_PACKET;
-
-    for (size_t fir_idx = start_fir_idx; fir_idx < end_fir_idx; ++fir_idx) {
-      for (size_t scan_idx = 0; scan_idx < SCANS_PER_FIRING; ++scan_idx) {
-        // Check if the point is valid.
-        if (!isPointInRange(firings[fir_idx].distance[scan_idx])) continue;
-
-        // Convert the point to xyz coordinate
-        size_t table_idx = floor(firings[fir_idx].azimuth[scan_idx]*1000.0+0.5);
-        //cout << table_idx << endl;
-        double cos_azimuth = cos_azimuth_table[table_idx];
-        double sin_azimuth = sin_azimuth_table[table_idx];
-
-        //double x = firings[fir_idx].distance[scan_idx] *
-        //  cos_scan_altitude[scan_idx] * sin(firings[fir_idx].azimuth[scan_idx]);
-        //double y = firings[fir_idx].distance[scan_idx] *
-        //  cos_scan_altitude[scan_idx] * cos(firings[fir_idx].azimuth[scan_idx]);
-        //double z = firings[fir_idx].distance[scan_idx] *
-        //  sin_scan_altitude[scan_idx];
-
-        double x = firings[fir_idx].distance[scan_idx] *
-          cos_scan_altitude[scan_idx] * sin_azimuth;
-        double y = firings[fir_idx].distance[scan_idx] *
-          cos_scan_altitude[scan_idx] * cos_azimuth;
-        double z = firings[fir_idx].distance[scan_idx] *
-          sin_scan_altitude[scan_idx];
-
-        double x_coord = y;
-        double y_coord = -x;
-        double z_coord = z;
-
-        // Compute the time of the point
-        double time = packet_start_time +
-          FIRING_TOFFSET*(fir_idx-start_fir_idx) + DSR_TOFFSET*scan_idx;
-
-        // Remap the index of the scan
-        int remapped_scan_idx = scan_idx%2 == 0 ? scan_idx/2 : scan_idx/2+8;
-        sweep_data->scans[remapped_scan_idx].points.push_back(
-            velodyne_puck_msgs::VelodynePuckPoint());
-        velodyne_puck_msgs::VelodynePuckPoint& new_point =
-          sweep_data->scans[remapped_scan_idx].points[
-          sweep_data->scans[remapped_scan_idx].points.size()-1];
+  ++flushed_sweeps;
+  ROS_WARN_THROTTLE(1.0, "No packets received for %.3f s. "
+      "Publishing the incomplete sweep.", (now_ns-last_arrival_ns)*1e-9);
+  publishSweep();
+  sweep_flushed = true;
+  return;
+}
 
-        // Pack the data into point msg
-        new_point.time = time;
-        new_point.x = x_coord;
-        new_point.y = y_coord;
-        new_point.z = z_coord;
-        new_point.azimuth = firings[fir_idx].azimuth[scan_idx];
-        new_point.distance = firings[fir_idx].distance[scan_idx];
-        new_point.intensity = firings[fir_idx].intensity[scan_idx];
-      }
-    }
+void VelodynePuckDecoder::latencyCallback(const ros::TimerEvent& event) {
+  velodyne_puck_msgs::VelodynePuckLatencyReportPtr report(
+      new velodyne_puck_msgs::VelodynePuckLatencyReport());
+  report->header.stamp = ros::Time::now();
+  report->header.frame_id = child_frame_id;
+  for (size_t bin = 0; bin+1 < LatencyHistogram::BINS; ++bin)
+    report->bin_upper_bounds.push_back(
+        LatencyHistogram::binUpperBound(bin)*1e-9);
 
-    packet_start_time += FIRING_TOFFSET * (end_fir_idx-start_fir_idx);
+  // Move the latencies since the last report out of the histograms.
+  report->stages.resize(LATENCY_STAGES);
+  for (size_t stage_idx = 0; stage_idx < LATENCY_STAGES; ++stage_idx) {
+    LatencyHistogram::Snapshot snapshot;
+    latency_histograms[stage_idx].collect(snapshot);
+
+    velodyne_puck_msgs::VelodynePuckLatencyStage& stage =
+      report->stages[stage_idx];
+    stage.name = LATENCY_STAGE_NAMES[stage_idx];
+    stage.count = snapshot.count;
+    stage.mean = snapshot.mean();
+    stage.p50 = snapshot.percentile(0.5);
+    stage.p90 = snapshot.percentile(0.9);
+    stage.p99 = snapshot.percentile(0.99);
+    stage.max = snapshot.max*1e-9;
+    stage.bins.assign(snapshot.bins, snapshot.bins+LatencyHistogram::BINS);
   }
+  latency_pub.publish(report);
 
+  boost::lock_guard<boost::mutex> lock(latency_mutex);
+  latency_report = *report;
   return;
 }
 
-} // end namespace velodyne_puck_decoder
+void VelodynePuckDecoder::packetCallback(
+    const velodyne_puck_msgs::VelodynePuckPacketConstPtr& msg) {
+  const uint64_t packet_seq = received_packets++;
+  VELODYNE_PUCK_DECODER_TRACE3(packet_callback_start, packet_seq,
+      msg->stamp.toNSec(), msg->data.size());
+
+  // Latency of the packet up to here. The driver stamps the
+  // packets with the time they were read from the socket.
+  if (trace_latency)
+    recordLatency(RECEIVE_TO_CALLBACK,
+        (ros::Time::now() - msg->stamp).toNSec());
+
+  if (!sensor_configured && !configureSensor(*msg)) {
+    VELODYNE_PUCK_DECODER_TRACE1(packet_callback_end, packet_seq);
+    return;
+  }
+
+  // Without the worker threads, the packet is decoded and
+  // assembled within the callback.
+  if (decode_threads <= 0) {
+    if (processPacket(*msg, firings)) assemblePacket(firings, msg);
+    VELODYNE_PUCK_DECODER_TRACE1(packet_callback_end, packet_seq);
+    return;
+  }
+
+  // Hand the packet over to the workers. Wait for a free slot
+  // if too many packets are in flight already.
+  boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+  PacketSlot* slot = &pipeline_slots[next_packet_seq%pipeline_slots.size()];
+  while (pipeline_running && slot->state != PacketSlot::FREE)
+    slot_freed.wait(lock);
+  if (!pipeline_running) {
+    VELODYNE_PUCK_DECODER_TRACE1(packet_callback_end, packet_seq);
+    return;
+  }
+
+  slot->msg = msg;
+  slot->state = PacketSlot::QUEUED;
+  pending_packets.push_back(next_packet_seq++);
+  packet_queued.notify_one();
+  VELODYNE_PUCK_DECODER_TRACE1(packet_callback_end, packet_seq);
+  return;
+}
+
+void VelodynePuckDecoder::decodeLoop() {
+  boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+  while (true) {
+    while (pipeline_running && pending_packets.empty())
+      packet_queued.wait(lock);
+    if (!pipeline_running) return;
+
+    PacketSlot& slot =
+      pipeline_slots[pending_packets.front()%pipeline_slots.size()];
+    pending_packets.pop_front();
 
+    // Decode the packet without holding the lock.
+    lock.unlock();
+    slot.valid = processPacket(*slot.msg, slot.firings);
+    lock.lock();
+
+    slot.state = PacketSlot::DECODED;
+    packet_decoded.notify_all();
+  }
+  return;
+}
+
+void VelodynePuckDecoder::assembleLoop() {
+  boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+  while (true) {
+    // The packets are assembled in the order they are received.
+    PacketSlot& slot =
+      pipeline_slots[next_assembled_seq%pipeline_slots.size()];
+    while (pipeline_running && slot.state != PacketSlot::DECODED)
+      packet_decoded.wait(lock);
+    if (!pipeline_running) return;
+
+    lock.unlock();
+    if (slot.valid) assemblePacket(slot.firings, slot.msg);
+    slot.msg.reset();
+    lock.lock();
+
+    slot.state = PacketSlot::FREE;
+    ++next_assembled_seq;
+    slot_freed.notify_all();
+  }
+  return;
+}
+
+void VelodynePuckDecoder::compressLoop() {
+  boost::unique_lock<boost::mutex> lock(compression_mutex);
+  while (true) {
+    while (compression_running && !pending_range_image)
+      range_image_queued.wait(lock);
+    if (!compression_running) return;
+
+    velodyne_puck_msgs::VelodynePuckRangeImageConstPtr image;
+    image.swap(pending_range_image);
+
+    // Compress the image without holding the lock.
+    lock.unlock();
+    ros::WallTime start_time = ros::WallTime::now();
+    velodyne_puck_msgs::VelodynePuckCompressedRangeImagePtr compressed =
+      compressed_range_image_pool.acquire();
+    bool encoded = range_image_codec.encode(*image, *compressed);
+    double time = (ros::WallTime::now() - start_time).toSec();
+    if (encoded) compressed_range_image_pub.publish(compressed);
+    lock.lock();
+
+    if (!encoded) continue;
+    ++compressed_images;
+    uncompressed_bytes += image->range.size()*sizeof(uint16_t) +
+      image->intensity.size()*sizeof(uint8_t) +
+      image->azimuth.size()*sizeof(uint16_t) +
+      image->time.size()*sizeof(float);
+    compressed_bytes += compressed->data.size();
+    encode_time += time;
+    max_encode_time = std::max(max_encode_time, time);
+  }
+  return;
+}
+
+} // end namespace velodyne_puck_decoder
@@ -0,0 +1,448 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <velodyne_puck_msgs/VelodynePuckPacket.h>
+#include <velodyne_puck_msgs/VelodynePuckSweep.h>
+#include <velodyne_puck_decoder/velodyne_puck_decoder.h>
+
+using namespace std;
+using namespace velodyne_puck_decoder;
+
+namespace {
+
+// No return of the corpus is beyond 13.1m, i.e. 6550 raw units,
+// where the fixed-point conversion is within 6550/2^14 + 1.5 units
+// (3.8mm) of the floating point one. So the xyz tolerance covers
+// both builds. The whole range is checked by xyz_conversion_test.
+static const double XYZ_TOLERANCE = 5e-3;               // [m]
+static const double AZIMUTH_TOLERANCE = 1e-5;           // [rad]
+static const double DISTANCE_TOLERANCE = 1e-4;          // [m]
+static const double COMPLETENESS_TOLERANCE = 1e-4;
+
+// The baseline decoder looked the azimuth up in a table of 1mrad
+// steps, which moves its points by up to half a step sideways.
+static const double BASELINE_AZIMUTH_STEP = 1e-3;       // [rad]
+// Its azimuths were not quantized to the 0.01 degree of the raw ones.
+static const double BASELINE_AZIMUTH_TOLERANCE = 0.01 * DEG_TO_RAD;
+// It mixed up the azimuth of the firings next to the wrap around,
+// so the points within a firing, 0.4 degree, of 0 are not compared.
+static const double BASELINE_WRAP_MARGIN = 1e-2;        // [rad]
+// It kept the time of the points in float32 microseconds.
+static const double BASELINE_TIME_TOLERANCE = 10.0;     // [ns]
+
+static const size_t PACKET_SIZE = 1206;
+
+struct GoldenPoint {
+  int ring;
+  uint32_t time_offset;
+  double x, y, z;
+  double azimuth;
+  double distance;
+  double intensity;
+};
+
+struct GoldenSweep {
+  int64_t stamp_offset;                                 // [ns]
+  double completeness;
+  vector<GoldenPoint> points;
+};
+
+string dataDirectory() {
+  string data_dir;
+  ros::NodeHandle("~").param<string>("data_dir", data_dir, "");
+  return data_dir;
+}
+
+bool readCorpus(const string& path,
+    vector<velodyne_puck_msgs::VelodynePuckPacketPtr>& packets) {
+  ifstream corpus(path.c_str(), ios::binary);
+  if (!corpus) return false;
+  while (true) {
+    velodyne_puck_msgs::VelodynePuckPacketPtr packet(
+        new velodyne_puck_msgs::VelodynePuckPacket());
+    corpus.read(reinterpret_cast<char*>(&packet->data[0]), PACKET_SIZE);
+    if (corpus.gcount() != static_cast<streamsize>(PACKET_SIZE)) break;
+    packets.push_back(packet);
+  }
+  return !packets.empty();
+}
+
+bool readGolden(const string& path, vector<GoldenSweep>& sweeps) {
+  ifstream golden(path.c_str());
+  if (!golden) return false;
+  string line;
+  while (getline(golden, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    istringstream fields(line);
+    if (line.compare(0, 5, "sweep") == 0) {
+      string tag;
+      GoldenSweep sweep;
+      fields >> tag >> sweep.stamp_offset >> sweep.completeness;
+      sweeps.push_back(sweep);
+      continue;
+    }
+    if (sweeps.empty()) return false;
+    GoldenPoint point;
+    fields >> point.ring >> point.time_offset >> point.x >> point.y >>
+      point.z >> point.azimuth >> point.distance >> point.intensity;
+    if (!fields) return false;
+    sweeps.back().points.push_back(point);
+  }
+  return true;
+}
+
+void writeGolden(const string& path, const string& corpus_name,
+    const ros::Time& start,
+    const vector<velodyne_puck_msgs::VelodynePuckSweepConstPtr>& sweeps) {
+  FILE* golden = fopen(path.c_str(), "w");
+  ASSERT_TRUE(golden != NULL) << "Cannot write " << path;
+  fprintf(golden, "# Sweeps decoded from %s\n", corpus_name.c_str());
+  fprintf(golden, "# sweep <stamp - first packet stamp [ns]> "
+      "<completeness>\n");
+  fprintf(golden, "# <ring> <time_offset> <x> <y> <z> "
+      "<azimuth> <distance> <intensity>\n");
+  for (size_t sweep_idx = 0; sweep_idx < sweeps.size(); ++sweep_idx) {
+    const velodyne_puck_msgs::VelodynePuckSweep& sweep = *sweeps[sweep_idx];
+    fprintf(golden, "sweep %lld %.6f\n", static_cast<long long>(
+          sweep.header.stamp.toNSec() - start.toNSec()), sweep.completeness);
+    for (size_t ring = 0; ring < sweep.scans.size(); ++ring) {
+      const vector<velodyne_puck_msgs::VelodynePuckPoint>& points =
+        sweep.scans[ring].points;
+      for (size_t pt_idx = 0; pt_idx < points.size(); ++pt_idx) {
+        const velodyne_puck_msgs::VelodynePuckPoint& point = points[pt_idx];
+        fprintf(golden, "%lu %u %.6f %.6f %.6f %.6f %.4f %.0f\n", ring,
+            point.time_offset, point.x, point.y, point.z,
+            point.azimuth, point.distance, point.intensity);
+      }
+    }
+  }
+  fclose(golden);
+  return;
+}
+
+/*
+ * Exposes the stages of the decoder, to check the decoded
+ * firings of a single packet.
+ */
+class StageDecoder : public VelodynePuckDecoder {
+public:
+  StageDecoder(ros::NodeHandle& nh, ros::NodeHandle& pnh):
+    VelodynePuckDecoder(nh, pnh) {}
+
+  using VelodynePuckDecoder::FiringBuffer;
+  using VelodynePuckDecoder::configureSensor;
+  using VelodynePuckDecoder::sensorInfo;
+  using VelodynePuckDecoder::processPacket;
+  using VelodynePuckDecoder::convertFirings;
+  using VelodynePuckDecoder::firingsPerPacket;
+};
+
+/*
+ * Feeds a corpus of raw packets to a decoder through the ROS
+ * topics, and compares the published sweeps with the golden
+ * sweeps. With UPDATE_GOLDEN set in the environment, the golden
+ * sweeps are written from the decoder output instead.
+ */
+class DecoderRegressionTest : public ::testing::Test {
+protected:
+  void sweepCallback(
+      const velodyne_puck_msgs::VelodynePuckSweepConstPtr& msg) {
+    sweeps.push_back(msg);
+    return;
+  }
+
+  void decode(const string& name, size_t firings_per_packet) {
+    const string data_dir = dataDirectory();
+    ASSERT_FALSE(data_dir.empty()) << "The data_dir parameter is not set";
+
+    vector<velodyne_puck_msgs::VelodynePuckPacketPtr> packets;
+    ASSERT_TRUE(readCorpus(data_dir + "/" + name + ".bin", packets))
+      << "Cannot read the corpus " << name;
+
+    // Each corpus runs in its own namespace with a new decoder.
+    ros::NodeHandle nh(name);
+    ros::NodeHandle pnh("~");
+    VelodynePuckDecoder decoder(nh, pnh);
+    ASSERT_TRUE(decoder.initialize());
+
+    ros::Subscriber sweep_sub = nh.subscribe(
+        "velodyne_sweep", 100, &DecoderRegressionTest::sweepCallback, this);
+    ros::Publisher packet_pub =
+      nh.advertise<velodyne_puck_msgs::VelodynePuckPacket>(
+          "velodyne_packet", 100);
+    ros::WallTime timeout = ros::WallTime::now() + ros::WallDuration(5.0);
+    while ((sweep_sub.getNumPublishers() == 0 ||
+          packet_pub.getNumSubscribers() == 0) &&
+        ros::WallTime::now() < timeout)
+      ros::WallDuration(0.01).sleep();
+
+    // The stamps follow the firing period of the sensor.
+    start = ros::Time::now();
+    const ros::Duration packet_duration(
+        firings_per_packet*FIRING_TOFFSET*1e-6);
+    for (size_t pkt_idx = 0; pkt_idx < packets.size(); ++pkt_idx) {
+      packets[pkt_idx]->stamp = start + packet_duration*pkt_idx;
+      packet_pub.publish(packets[pkt_idx]);
+      ros::spinOnce();
+    }
+    for (size_t spin_idx = 0; spin_idx < 10; ++spin_idx) {
+      ros::spinOnce();
+      ros::WallDuration(0.01).sleep();
+    }
+    return;
+  }
+
+  void compare(const string& name) {
+    const string golden_path = dataDirectory() + "/" + name + ".golden";
+    if (getenv("UPDATE_GOLDEN")) {
+      writeGolden(golden_path, name + ".bin", start, sweeps);
+      return;
+    }
+
+    vector<GoldenSweep> golden;
+    ASSERT_TRUE(readGolden(golden_path, golden))
+      << "Cannot read the golden sweeps " << golden_path;
+    ASSERT_EQ(golden.size(), sweeps.size());
+
+    for (size_t sweep_idx = 0; sweep_idx < sweeps.size(); ++sweep_idx) {
+      SCOPED_TRACE(testing::Message() << "sweep " << sweep_idx);
+      const velodyne_puck_msgs::VelodynePuckSweep& sweep = *sweeps[sweep_idx];
+      const GoldenSweep& expected = golden[sweep_idx];
+      EXPECT_EQ(expected.stamp_offset, static_cast<int64_t>(
+            sweep.header.stamp.toNSec() - start.toNSec()));
+      EXPECT_NEAR(expected.completeness, sweep.completeness,
+          COMPLETENESS_TOLERANCE);
+
+      size_t golden_idx = 0;
+      for (size_t ring = 0; ring < sweep.scans.size(); ++ring) {
+        const vector<velodyne_puck_msgs::VelodynePuckPoint>& points =
+          sweep.scans[ring].points;
+        for (size_t pt_idx = 0; pt_idx < points.size(); ++pt_idx) {
+          ASSERT_LT(golden_idx, expected.points.size())
+            << "More points than the golden sweep";
+          const GoldenPoint& golden_point = expected.points[golden_idx++];
+          const velodyne_puck_msgs::VelodynePuckPoint& point =
+            points[pt_idx];
+          SCOPED_TRACE(testing::Message() << "ring " << ring <<
+              " point " << pt_idx);
+          ASSERT_EQ(golden_point.ring, static_cast<int>(ring));
+          EXPECT_EQ(golden_point.time_offset, point.time_offset);
+          EXPECT_NEAR(golden_point.x, point.x, XYZ_TOLERANCE);
+          EXPECT_NEAR(golden_point.y, point.y, XYZ_TOLERANCE);
+          EXPECT_NEAR(golden_point.z, point.z, XYZ_TOLERANCE);
+          EXPECT_NEAR(golden_point.azimuth, point.azimuth,
+              AZIMUTH_TOLERANCE);
+          EXPECT_NEAR(golden_point.distance, point.distance,
+              DISTANCE_TOLERANCE);
+          EXPECT_EQ(golden_point.intensity, point.intensity);
+        }
+      }
+      EXPECT_EQ(expected.points.size(), golden_idx)
+        << "Fewer points than the golden sweep";
+    }
+    return;
+  }
+
+  // Compares the sweeps with the ones of the baseline decoder, which
+  // are never rewritten. The baseline split and misstamped the first
+  // sweep after startup, so only the sweeps it stamped the same are
+  // compared.
+  void compareBaseline(const string& name) {
+    const string baseline_path = dataDirectory() + "/" + name + ".baseline";
+    vector<GoldenSweep> baseline;
+    ASSERT_TRUE(readGolden(baseline_path, baseline))
+      << "Cannot read the baseline sweeps " << baseline_path;
+
+    size_t compared_points = 0;
+    for (size_t sweep_idx = 0; sweep_idx < sweeps.size(); ++sweep_idx) {
+      const velodyne_puck_msgs::VelodynePuckSweep& sweep = *sweeps[sweep_idx];
+      const int64_t stamp_offset = sweep.header.stamp.toNSec() - start.toNSec();
+      size_t baseline_idx = 0;
+      while (baseline_idx < baseline.size() &&
+          baseline[baseline_idx].stamp_offset != stamp_offset)
+        ++baseline_idx;
+      if (baseline_idx == baseline.size()) continue;
+
+      SCOPED_TRACE(testing::Message() << "sweep " << sweep_idx);
+      const GoldenSweep& expected = baseline[baseline_idx];
+      size_t golden_idx = 0;
+      for (size_t ring = 0; ring < sweep.scans.size(); ++ring) {
+        const vector<velodyne_puck_msgs::VelodynePuckPoint>& points =
+          sweep.scans[ring].points;
+        for (size_t pt_idx = 0; pt_idx < points.size(); ++pt_idx) {
+          ASSERT_LT(golden_idx, expected.points.size())
+            << "More points than the baseline sweep";
+          const GoldenPoint& golden_point = expected.points[golden_idx++];
+          const velodyne_puck_msgs::VelodynePuckPoint& point =
+            points[pt_idx];
+          SCOPED_TRACE(testing::Message() << "ring " << ring <<
+              " point " << pt_idx);
+          ASSERT_EQ(golden_point.ring, static_cast<int>(ring));
+          if (point.azimuth < BASELINE_WRAP_MARGIN ||
+              point.azimuth > 2.0*M_PI - BASELINE_WRAP_MARGIN) continue;
+          ++compared_points;
+          EXPECT_NEAR(golden_point.time_offset, point.time_offset,
+              BASELINE_TIME_TOLERANCE);
+          const double xyz_tolerance = XYZ_TOLERANCE +
+            0.5*BASELINE_AZIMUTH_STEP*golden_point.distance;
+          EXPECT_NEAR(golden_point.x, point.x, xyz_tolerance);
+          EXPECT_NEAR(golden_point.y, point.y, xyz_tolerance);
+          EXPECT_NEAR(golden_point.z, point.z, XYZ_TOLERANCE);
+          EXPECT_NEAR(golden_point.azimuth, point.azimuth,
+              BASELINE_AZIMUTH_TOLERANCE);
+          EXPECT_NEAR(golden_point.distance, point.distance,
+              DISTANCE_TOLERANCE);
+          EXPECT_EQ(golden_point.intensity, point.intensity);
+        }
+      }
+      EXPECT_EQ(expected.points.size(), golden_idx)
+        << "Fewer points than the baseline sweep";
+    }
+    EXPECT_GT(compared_points, 0u) << "No sweep in common with the baseline";
+    return;
+  }
+
+  ros::Time start;
+  vector<velodyne_puck_msgs::VelodynePuckSweepConstPtr> sweeps;
+};
+
+} // End namespace
+
+// The azimuth wraps around three times, and the partial
+// sweep before the first wrap around is dropped.
+TEST_F(DecoderRegressionTest, singleReturn) {
+  decode("vlp16_single", 24);
+  compare("vlp16_single");
+  ASSERT_EQ(2u, sweeps.size());
+  EXPECT_EQ(1.0, sweeps[0]->completeness);
+  EXPECT_EQ(1.0, sweeps[1]->completeness);
+}
+
+// The golden sweeps above are written by the decoder itself, so
+// vlp16_single.baseline keeps the output of the first release,
+// with the nominal VLP-16 geometry, to hold the decoder to it.
+TEST_F(DecoderRegressionTest, baselineDecoder) {
+  decode("vlp16_single", 24);
+  compareBaseline("vlp16_single");
+}
+
+// Each pair of blocks holds the two returns of the same firings,
+// which are kept next to each other at the time of the firing. The
+// sweeps cover the same revolutions as the single return corpus.
+// Timing the packets by their blocks rather than their firings
+// used to cut every revolution short on the time budget.
+TEST_F(DecoderRegressionTest, dualReturn) {
+  decode("vlp16_dual", 12);
+  compare("vlp16_dual");
+  ASSERT_EQ(2u, sweeps.size());
+
+  double frequency = 0.0;
+  ros::NodeHandle("~").param<double>("frequency", frequency, 20.0);
+  for (size_t sweep_idx = 0; sweep_idx < sweeps.size(); ++sweep_idx) {
+    SCOPED_TRACE(testing::Message() << "sweep " << sweep_idx);
+    const velodyne_puck_msgs::VelodynePuckSweep& sweep = *sweeps[sweep_idx];
+    EXPECT_NEAR(1.0, sweep.completeness, 1e-3);
+
+    // No point is later than a revolution from the start.
+    uint32_t max_time_offset = 0;
+    for (size_t ring = 0; ring < sweep.scans.size(); ++ring)
+      for (size_t pt_idx = 0; pt_idx < sweep.scans[ring].points.size();
+          ++pt_idx)
+        max_time_offset = std::max(max_time_offset,
+            sweep.scans[ring].points[pt_idx].time_offset);
+    EXPECT_LT(max_time_offset, 1.1e9/frequency);
+  }
+}
+
+// The packets with broken block headers or of another sensor
+// are skipped, and the sweeps are published as incomplete.
+TEST_F(DecoderRegressionTest, corruptedPackets) {
+  decode("vlp16_corrupted", 24);
+  compare("vlp16_corrupted");
+  ASSERT_EQ(2u, sweeps.size());
+  EXPECT_LT(sweeps[0]->completeness, 1.0);
+  EXPECT_LT(sweeps[1]->completeness, 1.0);
+}
+
+// A Puck Hi-Res packet, whose lasers span -10 to 10 degrees in steps
+// of 4/3 degree, fired alternately from the bottom and the middle.
+TEST(HiResPacketTest, altitudes) {
+  ros::NodeHandle nh("hi_res");
+  ros::NodeHandle pnh("~");
+  StageDecoder decoder(nh, pnh);
+  ASSERT_TRUE(decoder.initialize());
+
+  // All the shots return from 10m.
+  const uint16_t raw_distance = 5000;
+  velodyne_puck_msgs::VelodynePuckPacket packet;
+  for (size_t blk_idx = 0; blk_idx < 12; ++blk_idx) {
+    uint8_t* block = &packet.data[blk_idx*100];
+    const uint16_t header = 0xeeff;
+    const uint16_t rotation = blk_idx * 40;
+    memcpy(block, &header, 2);
+    memcpy(block+2, &rotation, 2);
+    for (size_t shot_idx = 0; shot_idx < 32; ++shot_idx) {
+      memcpy(block+4+shot_idx*3, &raw_distance, 2);
+      block[4+shot_idx*3+2] = 100;
+    }
+  }
+  packet.data[1204] = 0x37;
+  packet.data[1205] = 0x24;
+
+  ASSERT_TRUE(decoder.configureSensor(packet));
+  ASSERT_EQ(PUCK_HI_RES, decoder.sensorInfo().model);
+  StageDecoder::FiringBuffer firings;
+  ASSERT_TRUE(decoder.processPacket(packet, firings));
+  decoder.convertFirings(firings);
+
+  const double distance = raw_distance * DISTANCE_RESOLUTION;
+  for (size_t fir_idx = 0; fir_idx < decoder.firingsPerPacket(); ++fir_idx) {
+    for (size_t laser = 0; laser < 16; ++laser) {
+      SCOPED_TRACE(testing::Message() << "firing " << fir_idx <<
+          " laser " << laser);
+      const double altitude = (laser%2 == 0 ? -10.0 : 2.0/3.0) +
+        (laser/2) * 4.0/3.0;
+      const size_t shot_idx = fir_idx*16 + laser;
+      EXPECT_NEAR(distance*sin(altitude*M_PI/180.0), firings.z[shot_idx],
+          XYZ_TOLERANCE);
+      EXPECT_NEAR(distance*cos(altitude*M_PI/180.0),
+          hypot(firings.x[shot_idx], firings.y[shot_idx]), XYZ_TOLERANCE);
+    }
+    // The bottom and top lasers, at -10 and 10 degrees.
+    EXPECT_NEAR(distance*sin(-10.0*M_PI/180.0), firings.z[fir_idx*16],
+        XYZ_TOLERANCE);
+    EXPECT_NEAR(distance*sin(10.0*M_PI/180.0), firings.z[fir_idx*16+15],
+        XYZ_TOLERANCE);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "decoder_regression_test");
+  return RUN_ALL_TESTS();
+}
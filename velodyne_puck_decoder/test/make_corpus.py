@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+#
+# This file is part of velodyne_puck driver.
+#
+# The driver is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# The driver is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Write the packet corpus of the decoder regression test.
+
+Each corpus file is a plain concatenation of 1206 byte VLP-16 packets
+as they arrive in the data port. The packets are laid out as by the
+sensor spinning at 20Hz in a room, with the walls 8 to 12m away and
+the floor 1.8m below. Only one shot in 16 returns, which keeps the
+golden sweeps small while every laser and firing still shows up.
+
+    vlp16_single.bin     single (strongest) return, 90 packets
+    vlp16_dual.bin       dual return, 170 packets
+    vlp16_corrupted.bin  vlp16_single.bin with broken block headers
+                         and a packet of another sensor model
+
+All the files start at 300 degrees, so the first sweep is cut short
+and the azimuth wraps around within the corpus.
+
+Usage: make_corpus.py [output directory]
+"""
+
+import math
+import os
+import struct
+import sys
+
+PACKET_SIZE = 1206
+BLOCKS_PER_PACKET = 12
+FIRINGS_PER_BLOCK = 2
+LASERS = 16
+
+UPPER_BANK = 0xeeff
+STRONGEST_RETURN = 0x37
+DUAL_RETURN = 0x39
+VLP16 = 0x22
+VLP32C = 0x28
+
+FREQUENCY = 20.0
+FIRING_TOFFSET = 55.296e-6
+DISTANCE_RESOLUTION = 0.002
+START_AZIMUTH = 300.0
+
+# Altitudes of the lasers in the order they are fired [deg]
+ALTITUDES = [-15, 1, -13, 3, -11, 5, -9, 7, -7, 9, -5, 11, -3, 13, -1, 15]
+
+# Raw azimuth step between the blocks, two firings apart
+BLOCK_AZIMUTH_STEP = FIRINGS_PER_BLOCK * 36000.0 * FREQUENCY * FIRING_TOFFSET
+
+
+def shot_distance(azimuth, laser, firing):
+  """Distance of a shot of the room [m], 0 for no return."""
+  if (firing + laser) % 16 != 0:
+    return 0.0
+  # Some returns from right in front of the sensor,
+  # which are below the minimum range of the decoder.
+  if firing % 160 == 0:
+    return 0.4
+  altitude = math.radians(ALTITUDES[laser])
+  wall = (10.0 + 2.0*math.cos(2.0*math.radians(azimuth))) / math.cos(altitude)
+  if altitude < 0.0:
+    return min(wall, 1.8 / math.sin(-altitude))
+  return wall
+
+
+def block(azimuth, first_firing, extra_distance=0.0):
+  raw_azimuth = int(round(azimuth * 100.0)) % 36000
+  data = struct.pack('<HH', UPPER_BANK, raw_azimuth)
+  for firing in range(first_firing, first_firing + FIRINGS_PER_BLOCK):
+    for laser in range(LASERS):
+      distance = shot_distance(azimuth, laser, firing)
+      if distance > 0.0:
+        distance += extra_distance
+      raw_distance = int(round(distance / DISTANCE_RESOLUTION))
+      intensity = (int(azimuth) + 7*laser) % 256
+      data += struct.pack('<HB', raw_distance, intensity)
+  return data
+
+
+def packet(blocks, packet_idx, return_mode):
+  # The timestamp field counts microseconds past the hour.
+  usec = int(round(packet_idx * BLOCKS_PER_PACKET * FIRINGS_PER_BLOCK *
+                   FIRING_TOFFSET * 1e6))
+  data = b''.join(blocks) + struct.pack('<IBB', usec, return_mode, VLP16)
+  assert len(data) == PACKET_SIZE
+  return data
+
+
+def single_return(packets):
+  corpus = []
+  for packet_idx in range(packets):
+    blocks = []
+    for block_idx in range(BLOCKS_PER_PACKET):
+      idx = packet_idx*BLOCKS_PER_PACKET + block_idx
+      azimuth = (START_AZIMUTH + idx*BLOCK_AZIMUTH_STEP/100.0) % 360.0
+      blocks.append(block(azimuth, idx*FIRINGS_PER_BLOCK))
+    corpus.append(packet(blocks, packet_idx, STRONGEST_RETURN))
+  return corpus
+
+
+def dual_return(packets):
+  # The blocks come in pairs of the same firings, the last
+  # return first and the strongest one second.
+  corpus = []
+  for packet_idx in range(packets):
+    blocks = []
+    for pair_idx in range(BLOCKS_PER_PACKET // 2):
+      idx = packet_idx*BLOCKS_PER_PACKET//2 + pair_idx
+      azimuth = (START_AZIMUTH + idx*BLOCK_AZIMUTH_STEP/100.0) % 360.0
+      blocks.append(block(azimuth, idx*FIRINGS_PER_BLOCK, 0.6))
+      blocks.append(block(azimuth, idx*FIRINGS_PER_BLOCK))
+    corpus.append(packet(blocks, packet_idx, DUAL_RETURN))
+  return corpus
+
+
+def corrupted(packets):
+  corpus = [bytearray(data) for data in single_return(packets)]
+  # A block header broken in two consecutive packets
+  for packet_idx in (20, 21):
+    struct.pack_into('<H', corpus[packet_idx], 5*100, 0)
+  # The first block header
+  struct.pack_into('<H', corpus[60], 0, 0xdead)
+  # A packet of another sensor
+  corpus[50][PACKET_SIZE - 1] = VLP32C
+  return [bytes(data) for data in corpus]
+
+
+def main():
+  directory = sys.argv[1] if len(sys.argv) > 1 else os.path.join(
+      os.path.dirname(os.path.abspath(__file__)), 'data')
+  for name, corpus in (('vlp16_single.bin', single_return(90)),
+                       ('vlp16_dual.bin', dual_return(170)),
+                       ('vlp16_corrupted.bin', corrupted(90))):
+    with open(os.path.join(directory, name), 'wb') as corpus_file:
+      corpus_file.write(b''.join(corpus))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,163 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <vector>
+#include <gtest/gtest.h>
+#include <velodyne_puck_decoder/range_image_codec.h>
+
+using namespace std;
+using namespace velodyne_puck_decoder;
+
+namespace {
+
+typedef velodyne_puck_msgs::VelodynePuckRangeImage RangeImage;
+typedef velodyne_puck_msgs::VelodynePuckCompressedRangeImage
+  CompressedRangeImage;
+
+// A range image of a sensor spinning from the given raw azimuth, with
+// one column per firing 0.2 degree apart. One reading in seven has
+// no return, and the rows carry the corrections of a calibration.
+RangeImage makeImage(const size_t& height, const size_t& width,
+    const uint16_t& start_azimuth) {
+  RangeImage image;
+  image.header.seq = 7;
+  image.header.stamp = ros::Time(1500000000, 123456789);
+  image.header.frame_id = "velodyne";
+  image.height = height;
+  image.width = width;
+  image.distance_resolution = 0.002f;
+
+  srand(height*width);
+  for (size_t row = 0; row < height; ++row) {
+    image.altitude.push_back(-0.4f + 0.025f*row);
+    image.row_time_offset.push_back(2.304e-6f * row);
+    image.rot_correction.push_back(0.001f*row - 0.01f);
+    image.dist_correction.push_back(0.03f + 0.001f*row);
+    image.vert_offset_correction.push_back(0.01f*(row%3));
+    image.horiz_offset_correction.push_back(row%2 ? 0.026f : -0.026f);
+  }
+  for (size_t column = 0; column < width; ++column) {
+    image.azimuth.push_back(static_cast<uint16_t>(
+          (start_azimuth + 20*column) % 36000));
+    image.time.push_back(55.296e-6f * column);
+  }
+  for (size_t row = 0; row < height; ++row) {
+    for (size_t column = 0; column < width; ++column) {
+      image.range.push_back(rand() % 7 == 0 ? 0 :
+          static_cast<uint16_t>(2000 + rand() % 63000));
+      image.intensity.push_back(static_cast<uint8_t>(rand() % 256));
+    }
+  }
+  return image;
+}
+
+void expectEqual(const RangeImage& expected, const RangeImage& image) {
+  EXPECT_EQ(expected.header.seq, image.header.seq);
+  EXPECT_EQ(expected.header.stamp, image.header.stamp);
+  EXPECT_EQ(expected.header.frame_id, image.header.frame_id);
+  EXPECT_EQ(expected.height, image.height);
+  EXPECT_EQ(expected.width, image.width);
+  EXPECT_EQ(expected.distance_resolution, image.distance_resolution);
+  EXPECT_EQ(expected.altitude, image.altitude);
+  EXPECT_EQ(expected.row_time_offset, image.row_time_offset);
+  EXPECT_EQ(expected.rot_correction, image.rot_correction);
+  EXPECT_EQ(expected.dist_correction, image.dist_correction);
+  EXPECT_EQ(expected.vert_offset_correction, image.vert_offset_correction);
+  EXPECT_EQ(expected.horiz_offset_correction,
+      image.horiz_offset_correction);
+  EXPECT_EQ(expected.range, image.range);
+  EXPECT_EQ(expected.intensity, image.intensity);
+  EXPECT_EQ(expected.azimuth, image.azimuth);
+  EXPECT_EQ(expected.time, image.time);
+  return;
+}
+
+void expectRoundTrip(const RangeImage& image) {
+  RangeImageCodec codec;
+  CompressedRangeImage compressed;
+  ASSERT_TRUE(codec.encode(image, compressed));
+  EXPECT_EQ(RangeImageCodec::FORMAT, compressed.format);
+
+  // A fresh image, so nothing is left over from the original.
+  RangeImage restored;
+  ASSERT_TRUE(codec.decode(compressed, restored));
+  expectEqual(image, restored);
+  return;
+}
+
+} // End namespace
+
+// A revolution of a VLP-16, which wraps around from 35999 to 0.
+TEST(RangeImageCodecTest, azimuthWrap) {
+  RangeImage image = makeImage(16, 1800, 30000);
+  ASSERT_GT(image.azimuth.front(), image.azimuth.back());
+  expectRoundTrip(image);
+}
+
+// All the readings without a return, and all of them with one.
+TEST(RangeImageCodecTest, noReturn) {
+  RangeImage image = makeImage(16, 100, 0);
+  std::fill(image.range.begin(), image.range.end(), 0);
+  expectRoundTrip(image);
+  std::fill(image.range.begin(), image.range.end(), 65535);
+  expectRoundTrip(image);
+}
+
+TEST(RangeImageCodecTest, emptyImage) {
+  expectRoundTrip(makeImage(16, 0, 0));
+  expectRoundTrip(makeImage(0, 0, 0));
+}
+
+TEST(RangeImageCodecTest, vlp32c) {
+  expectRoundTrip(makeImage(32, 1800, 17999));
+}
+
+// The codec keeps its buffers, so images of different sizes in a
+// row must not leave anything behind.
+TEST(RangeImageCodecTest, reuse) {
+  RangeImageCodec codec;
+  const RangeImage images[] = {makeImage(32, 1800, 100),
+    makeImage(16, 900, 35000), makeImage(16, 0, 0), makeImage(16, 20, 5)};
+  RangeImage restored;
+  for (size_t image_idx = 0; image_idx < 4; ++image_idx) {
+    SCOPED_TRACE(testing::Message() << "image " << image_idx);
+    CompressedRangeImage compressed;
+    ASSERT_TRUE(codec.encode(images[image_idx], compressed));
+    ASSERT_TRUE(codec.decode(compressed, restored));
+    expectEqual(images[image_idx], restored);
+  }
+}
+
+TEST(RangeImageCodecTest, invalidImages) {
+  RangeImageCodec codec;
+  CompressedRangeImage compressed;
+  RangeImage image = makeImage(16, 10, 0);
+  image.range.pop_back();
+  EXPECT_FALSE(codec.encode(image, compressed));
+
+  ASSERT_TRUE(codec.encode(makeImage(16, 10, 0), compressed));
+  compressed.data.resize(compressed.data.size()/2);
+  RangeImage restored;
+  EXPECT_FALSE(codec.decode(compressed, restored));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <velodyne_puck_decoder/xyz_conversion.h>
+
+using namespace std;
+using namespace velodyne_puck_decoder;
+
+namespace {
+
+static const double RESOLUTION = 0.002;                 // [m]
+static const size_t LASERS = 16;
+
+// Slack for the rounding of the floating point path [m].
+static const double FLOAT_TOLERANCE = 1e-5;
+
+/*
+ * Converts the same shots with both conversions, over the whole range
+ * of raw distances, and checks the fixed-point coordinates against the
+ * error bound of convertToXyzFixed. The lasers span the altitudes of
+ * the supported sensors, with the offsets of a calibration.
+ */
+class XyzConversionTest : public ::testing::Test {
+protected:
+  void SetUp() {
+    for (size_t laser_idx = 0; laser_idx < LASERS; ++laser_idx) {
+      double altitude = (-25.0 + 40.0*laser_idx/(LASERS-1)) * M_PI / 180.0;
+      double horizontal_offset = 0.01*laser_idx - 0.08;
+      double vertical_offset = 0.005*laser_idx;
+      double lateral_offset = laser_idx%2 ? 0.026 : -0.026;
+
+      LaserFactors<float>& factors = laser_factors[laser_idx];
+      factors.horizontal_factor = RESOLUTION*cos(altitude);
+      factors.vertical_factor = RESOLUTION*sin(altitude);
+      factors.horizontal_offset = horizontal_offset;
+      factors.vertical_offset = vertical_offset;
+      factors.lateral_offset = lateral_offset;
+
+      LaserFactors<int32_t>& fixed_factors = fixed_laser_factors[laser_idx];
+      fixed_factors.horizontal_factor = toFixedPoint(cos(altitude));
+      fixed_factors.vertical_factor = toFixedPoint(sin(altitude));
+      fixed_factors.horizontal_offset =
+        toFixedPoint(horizontal_offset/RESOLUTION);
+      fixed_factors.vertical_offset =
+        toFixedPoint(vertical_offset/RESOLUTION);
+      fixed_factors.lateral_offset = static_cast<int32_t>(
+          floor(lateral_offset/RESOLUTION + 0.5));
+    }
+    return;
+  }
+
+  void compare(const vector<uint16_t>& distance,
+      const vector<uint16_t>& azimuth) {
+    const size_t firings = distance.size() / LASERS;
+    vector<float> x(distance.size()), y(distance.size()), z(distance.size());
+    vector<float> fixed_x(distance.size()), fixed_y(distance.size()),
+      fixed_z(distance.size());
+    convertToXyz(&distance[0], &azimuth[0], laser_factors, azimuthTable(),
+        firings, LASERS, &x[0], &y[0], &z[0]);
+    convertToXyzFixed(&distance[0], &azimuth[0], fixed_laser_factors,
+        fixedAzimuthTable(), static_cast<float>(RESOLUTION),
+        firings, LASERS, &fixed_x[0], &fixed_y[0], &fixed_z[0]);
+
+    for (size_t shot_idx = 0; shot_idx < distance.size(); ++shot_idx) {
+      const double horizontal_bound = RESOLUTION *
+        (distance[shot_idx]/double(FIXED_POINT_ONE) + 1.5) + FLOAT_TOLERANCE;
+      const double vertical_bound = RESOLUTION *
+        (distance[shot_idx]/(2.0*FIXED_POINT_ONE) + 0.5) + FLOAT_TOLERANCE;
+      ASSERT_NEAR(x[shot_idx], fixed_x[shot_idx], horizontal_bound)
+        << "shot " << shot_idx;
+      ASSERT_NEAR(y[shot_idx], fixed_y[shot_idx], horizontal_bound)
+        << "shot " << shot_idx;
+      ASSERT_NEAR(z[shot_idx], fixed_z[shot_idx], vertical_bound)
+        << "shot " << shot_idx;
+    }
+    return;
+  }
+
+  LaserFactors<float> laser_factors[LASERS];
+  LaserFactors<int32_t> fixed_laser_factors[LASERS];
+};
+
+} // End namespace
+
+// Every raw distance, at azimuths spread over the revolution.
+TEST_F(XyzConversionTest, allDistances) {
+  vector<uint16_t> distance, azimuth;
+  for (uint32_t raw_distance = 0; raw_distance <= 65535; ++raw_distance) {
+    for (size_t laser_idx = 0; laser_idx < LASERS; ++laser_idx) {
+      distance.push_back(static_cast<uint16_t>(raw_distance));
+      azimuth.push_back(static_cast<uint16_t>(
+            (raw_distance*7919 + laser_idx*1297) % RAW_AZIMUTH_COUNT));
+    }
+  }
+  compare(distance, azimuth);
+}
+
+// Every azimuth, at the longest raw distances.
+TEST_F(XyzConversionTest, longRange) {
+  vector<uint16_t> distance, azimuth;
+  for (int raw_azimuth = 0; raw_azimuth < RAW_AZIMUTH_COUNT; ++raw_azimuth) {
+    for (size_t laser_idx = 0; laser_idx < LASERS; ++laser_idx) {
+      distance.push_back(static_cast<uint16_t>(65535 - laser_idx*100));
+      azimuth.push_back(static_cast<uint16_t>(raw_azimuth));
+    }
+  }
+  compare(distance, azimuth);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
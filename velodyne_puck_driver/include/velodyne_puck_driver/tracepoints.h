@@ -0,0 +1,44 @@
+/*
+ * This file is part of velodyne_puck driver.
+ *
+ * The driver is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The driver is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the driver.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef VELODYNE_PUCK_DRIVER_TRACEPOINTS_H
+#define VELODYNE_PUCK_DRIVER_TRACEPOINTS_H
+
+// Static tracepoints of the driver for perf, bpftrace or LTTng,
+// under the USDT provider velodyne_puck_driver. They are built in
+// when sys/sdt.h is available, and are a single nop while no tracer
+// is attached. The arguments are evaluated either way, so they must
+// be cheap to compute.
+#ifdef VELODYNE_PUCK_TRACEPOINTS
+#include <sys/sdt.h>
+#define VELODYNE_PUCK_DRIVER_TRACE1(probe, a1) \
+  DTRACE_PROBE1(velodyne_puck_driver, probe, a1)
+#define VELODYNE_PUCK_DRIVER_TRACE2(probe, a1, a2) \
+  DTRACE_PROBE2(velodyne_puck_driver, probe, a1, a2)
+#define VELODYNE_PUCK_DRIVER_TRACE3(probe, a1, a2, a3) \
+  DTRACE_PROBE3(velodyne_puck_driver, probe, a1, a2, a3)
+#else
+#define VELODYNE_PUCK_DRIVER_TRACE1(probe, a1) \
+  do { (void) (a1); } while (0)
+#define VELODYNE_PUCK_DRIVER_TRACE2(probe, a1, a2) \
+  do { (void) (a1); (void) (a2); } while (0)
+#define VELODYNE_PUCK_DRIVER_TRACE3(probe, a1, a2, a3) \
+  do { (void) (a1); (void) (a2); (void) (a3); } while (0)
+#endif
+
+#endif
@@ -60,6 +60,9 @@ private:
   in_addr device_ip;
   int socket_id;
 
+  // Sequence number of the packets in the tracepoints
+  uint64_t packet_seq;
+
   // ROS related variables
   ros::NodeHandle nh;
   ros::NodeHandle pnh;
@@ -29,6 +29,7 @@
 #include <tf/transform_listener.h>
 
 #include <velodyne_puck_driver/velodyne_puck_driver.h>
+#include <velodyne_puck_driver/tracepoints.h>
 
 namespace velodyne_puck_driver {
 
@@ -36,7 +37,8 @@ VelodynePuckDriver::VelodynePuckDriver(
     ros::NodeHandle& n, ros::NodeHandle& pn):
   nh(n),
   pnh(pn),
-  socket_id(-1){
+  socket_id(-1),
+  packet_seq(0) {
   return;
 }
 
@@ -184,6 +186,7 @@ int VelodynePuckDriver::getPacket(
     // socket using a blocking read.
     ssize_t nbytes = recvfrom(socket_id, &packet->data[0], PACKET_SIZE,  0,
         (sockaddr*) &sender_address, &sender_address_len);
+    VELODYNE_PUCK_DRIVER_TRACE2(recvfrom, packet_seq, nbytes);
 
     if (nbytes < 0)
     {
@@ -238,14 +241,20 @@ bool VelodynePuckDriver::polling()
   while (true)
   {
     // keep reading until full packet received
+    VELODYNE_PUCK_DRIVER_TRACE1(get_packet_entry, packet_seq);
     int rc = getPacket(packet);
+    VELODYNE_PUCK_DRIVER_TRACE3(get_packet_exit, packet_seq, rc,
+        packet->stamp.toNSec());
     if (rc == 0) break;       // got a full packet?
     if (rc < 0) return false; // end of file reached?
   }
 
   // publish message using time of last packet read
   ROS_DEBUG("Publishing a full Velodyne scan.");
+  VELODYNE_PUCK_DRIVER_TRACE3(packet_publish, packet_seq,
+      packet->stamp.toNSec(), packet->data.size());
   packet_pub.publish(*packet);
+  ++packet_seq;
 
   // notify diagnostics that a message has been published, updating
   // its status